@@ -0,0 +1,60 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARENA_BASE_ALIGN 64 // cache line
+
+bool arena_init(struct Arena *arena, const char *name, size_t capacity)
+{
+    // aligned_alloc wants the size to be a multiple of the alignment.
+    capacity = (capacity + ARENA_BASE_ALIGN - 1) & ~(size_t)(ARENA_BASE_ALIGN - 1);
+    arena->name = name;
+    arena->base = aligned_alloc(ARENA_BASE_ALIGN, capacity);
+    arena->capacity = arena->base ? capacity : 0;
+    arena->offset = 0;
+    arena->high_water = 0;
+    if (arena->base == NULL)
+    {
+        printf("Failed to allocate %zu bytes for arena '%s'.\n", capacity, name);
+        return false;
+    }
+    return true;
+}
+
+void arena_destroy(struct Arena *arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->offset = 0;
+}
+
+void *arena_alloc(struct Arena *arena, size_t size, size_t align)
+{
+    uintptr_t start = (uintptr_t)arena->base + arena->offset;
+    uintptr_t aligned = (start + align - 1) & ~(uintptr_t)(align - 1);
+    size_t offset = (size_t)(aligned - (uintptr_t)arena->base);
+    if (offset > arena->capacity || size > arena->capacity - offset)
+    {
+        printf("Arena '%s' exhausted: %zu bytes requested, %zu of %zu in use.\n",
+               arena->name, size, arena->offset, arena->capacity);
+        return NULL;
+    }
+
+    arena->offset = offset + size;
+    if (arena->offset > arena->high_water)
+        arena->high_water = arena->offset;
+    return arena->base + offset;
+}
+
+void arena_reset(struct Arena *arena)
+{
+    arena->offset = 0;
+}
+
+void arena_report(const struct Arena *arena)
+{
+    printf("Arena '%s': %zu / %zu bytes in use, high-water mark %zu bytes.\n",
+           arena->name, arena->offset, arena->capacity, arena->high_water);
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bump allocator over one fixed, preallocated block. Allocations are released
+// all at once by arena_reset (per frame / per pass), so steady-state frames
+// never touch the heap and the capacity caps peak memory.
+//
+// Not thread-safe: an arena is allocated from by one thread at a time, in
+// serial code (e.g. before a parallel_for hands the scratch to its ranges).
+struct Arena
+{
+    const char *name;
+    unsigned char *base;
+    size_t capacity;
+    size_t offset;
+    size_t high_water; // largest offset ever reached
+};
+
+bool arena_init(struct Arena *arena, const char *name, size_t capacity);
+void arena_destroy(struct Arena *arena);
+
+// Returns NULL (and reports it) if the request does not fit. align must be a power of two.
+void *arena_alloc(struct Arena *arena, size_t size, size_t align);
+
+// Release everything allocated from the arena.
+void arena_reset(struct Arena *arena);
+
+// Print current use and high-water mark.
+void arena_report(const struct Arena *arena);
+
+#endif // ARENA_H
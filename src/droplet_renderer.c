@@ -0,0 +1,255 @@
+#include "droplet_renderer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bind three SoA planes of vbo, starting first floats in, to attributes 0/1/2 of the current VAO.
+static void setupPlanes(GLuint vbo, size_t first, int planeLength)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        size_t offset = sizeof(float) * (first + (size_t)planeLength * axis);
+        glVertexAttribPointer(axis, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)offset);
+        glEnableVertexAttribArray(axis);
+    }
+}
+
+// Allocate storage for a buffer of floatCount floats.
+// Returns the persistent mapping, or NULL if the plain glBufferData path was used.
+static float *allocatePlanes(GLuint vbo, size_t floatCount, bool persistent)
+{
+    GLsizeiptr size = sizeof(float) * (GLsizeiptr)floatCount;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        return glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    }
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    return NULL;
+}
+
+bool dropletRendererInit(struct DropletRenderer *r, int max_droplets)
+{
+    memset(r, 0, sizeof(*r));
+    r->capacity = max_droplets;
+    r->trail_capacity = max_droplets * TRAIL_LENGTH;
+    r->point_stride = 1;
+    r->trail_stride = 1;
+    r->trail_step = 1;
+    r->point_size = 4.0f;
+
+    if (!shaderProgramLoad(&r->program, "droplet_vertex_shader.glsl", "fragment_shader.glsl"))
+        return false;
+
+    r->trail_first = malloc(sizeof(GLint) * max_droplets);
+    r->trail_count = malloc(sizeof(GLsizei) * max_droplets);
+    if (!r->trail_first || !r->trail_count)
+    {
+        printf("Failed to allocate droplet renderer memory.\n");
+        dropletRendererDestroy(r);
+        return false;
+    }
+
+    bool persistent = SDL_GL_ExtensionSupported("GL_ARB_buffer_storage");
+    int pointPlane = r->capacity * DROPLET_RENDER_REGIONS;
+    int trailPlane = r->trail_capacity * DROPLET_RENDER_REGIONS;
+    size_t trailBase = (size_t)pointPlane * 3; // trail planes follow the point planes
+    size_t floatCount = trailBase + (size_t)trailPlane * 3;
+
+    glGenBuffers(1, &r->vbo);
+    float *map = allocatePlanes(r->vbo, floatCount, persistent);
+    if (map == NULL && persistent)
+    {
+        // Mapping failed, and immutable storage cannot be respecified: recreate the buffer.
+        glDeleteBuffers(1, &r->vbo);
+        glGenBuffers(1, &r->vbo);
+        allocatePlanes(r->vbo, floatCount, false);
+    }
+
+    glGenVertexArrays(1, &r->point_vao);
+    glBindVertexArray(r->point_vao);
+    setupPlanes(r->vbo, 0, pointPlane);
+    glGenVertexArrays(1, &r->trail_vao);
+    glBindVertexArray(r->trail_vao);
+    setupPlanes(r->vbo, trailBase, trailPlane);
+
+    if (map)
+    {
+        r->point_map = map;
+        r->trail_map = map + trailBase;
+    }
+    else
+    {
+        // No buffer_storage (or mapping failed): stage on the CPU instead.
+        r->point_staging = malloc(sizeof(float) * r->capacity * 3);
+        r->trail_staging = malloc(sizeof(float) * r->trail_capacity * 3);
+        if (!r->point_staging || !r->trail_staging)
+        {
+            printf("Failed to allocate droplet renderer memory.\n");
+            dropletRendererDestroy(r);
+            return false;
+        }
+    }
+
+    glBindVertexArray(0);
+    return true;
+}
+
+// Copy the first n entries of three staging planes (stride capacity) into the
+// planes starting base floats into vbo, at element first of each plane.
+static void uploadPlanes(GLuint vbo, size_t base, const float *staging, int capacity, int planeLength, int first, int n)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        GLintptr offset = sizeof(float) * ((GLintptr)base + (GLintptr)planeLength * axis + first);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(float) * n, staging + (size_t)capacity * axis);
+    }
+}
+
+void dropletRendererDraw(struct DropletRenderer *r, const struct Droplet *droplets, int count, const float *mvp)
+{
+    int region = r->region;
+    int pointPlane = r->capacity * DROPLET_RENDER_REGIONS;
+    int trailPlane = r->trail_capacity * DROPLET_RENDER_REGIONS;
+    int pointFirst = region * r->capacity;
+    int trailFirst = region * r->trail_capacity;
+
+    // Write pointers for x/y/z planes of this frame's region.
+    float *px, *py, *pz, *tx, *ty, *tz;
+    if (r->point_map)
+    {
+        if (r->fences[region])
+        {
+            // The region must not be written until the GPU is done reading it,
+            // so keep waiting through timeouts (flushing only once).
+            GLenum status = glClientWaitSync(r->fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(r->fences[region], 0, 1000000000ull);
+            if (status == GL_WAIT_FAILED)
+            {
+                printf("Droplet renderer fence wait failed, finishing GPU work instead.\n");
+                glFinish();
+            }
+            glDeleteSync(r->fences[region]);
+            r->fences[region] = 0;
+        }
+        px = r->point_map + pointFirst;
+        py = px + pointPlane;
+        pz = py + pointPlane;
+        tx = r->trail_map + trailFirst;
+        ty = tx + trailPlane;
+        tz = ty + trailPlane;
+    }
+    else
+    {
+        px = r->point_staging;
+        py = px + r->capacity;
+        pz = py + r->capacity;
+        tx = r->trail_staging;
+        ty = tx + r->trail_capacity;
+        tz = ty + r->trail_capacity;
+    }
+
+    int numPoints = 0;
+    for (int i = 0; i < count && numPoints < r->capacity; i += r->point_stride)
+    {
+        if (!droplets[i].active)
+            continue;
+        px[numPoints] = droplets[i].x;
+        py[numPoints] = droplets[i].y;
+        pz[numPoints] = droplets[i].z;
+        numPoints++;
+    }
+
+    int numTrails = 0;
+    int numTrailVerts = 0;
+    for (int i = 0; i < count && numTrails < r->capacity; i += r->trail_stride)
+    {
+        const struct Droplet *d = &droplets[i];
+        if (!d->active || d->trail_count < 2)
+            continue;
+        if (numTrailVerts + TRAIL_LENGTH > r->trail_capacity)
+            break;
+
+        int start = numTrailVerts;
+        for (int k = 0; k < d->trail_count; k += r->trail_step)
+        {
+            tx[numTrailVerts] = d->trail[k][0];
+            ty[numTrailVerts] = d->trail[k][1];
+            tz[numTrailVerts] = d->trail[k][2];
+            numTrailVerts++;
+        }
+        // Always end on the newest sample so the trail meets the droplet.
+        int last = d->trail_count - 1;
+        if (last % r->trail_step != 0)
+        {
+            tx[numTrailVerts] = d->trail[last][0];
+            ty[numTrailVerts] = d->trail[last][1];
+            tz[numTrailVerts] = d->trail[last][2];
+            numTrailVerts++;
+        }
+        r->trail_first[numTrails] = trailFirst + start;
+        r->trail_count[numTrails] = numTrailVerts - start;
+        numTrails++;
+    }
+
+    if (!r->point_map)
+    {
+        size_t trailBase = (size_t)pointPlane * 3;
+        uploadPlanes(r->vbo, 0, r->point_staging, r->capacity, pointPlane, pointFirst, numPoints);
+        uploadPlanes(r->vbo, trailBase, r->trail_staging, r->trail_capacity, trailPlane, trailFirst, numTrailVerts);
+    }
+
+    const GLint *uniforms = r->program.uniforms;
+    glUseProgram(r->program.id);
+    if (r->program_generation != r->program.generation)
+    {
+        // Droplets are always drawn with the override color; set it again after a relink.
+        glUniform1i(uniforms[UNIFORM_USE_OVERRIDE_COLOR], 1);
+        glUniform4f(uniforms[UNIFORM_OVERRIDE_COLOR], 0.0f, 0.0f, 0.0f, 1.0f);
+        r->program_generation = r->program.generation;
+    }
+    glUniformMatrix4fv(uniforms[UNIFORM_MVP], 1, GL_FALSE, mvp);
+
+    glBindVertexArray(r->point_vao);
+    glPointSize(r->point_size);
+    glDrawArrays(GL_POINTS, pointFirst, numPoints);
+
+    glBindVertexArray(r->trail_vao);
+    glLineWidth(2.0f);
+    glMultiDrawArrays(GL_LINE_STRIP, r->trail_first, r->trail_count, numTrails);
+
+    if (r->point_map)
+        r->fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    r->region = (region + 1) % DROPLET_RENDER_REGIONS;
+}
+
+void dropletRendererDestroy(struct DropletRenderer *r)
+{
+    for (int i = 0; i < DROPLET_RENDER_REGIONS; i++)
+    {
+        if (r->fences[i])
+            glDeleteSync(r->fences[i]);
+    }
+    if (r->point_map)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    if (r->point_vao)
+        glDeleteVertexArrays(1, &r->point_vao);
+    if (r->trail_vao)
+        glDeleteVertexArrays(1, &r->trail_vao);
+    if (r->vbo)
+        glDeleteBuffers(1, &r->vbo);
+    shaderProgramDestroy(&r->program);
+    free(r->point_staging);
+    free(r->trail_staging);
+    free(r->trail_first);
+    free(r->trail_count);
+    memset(r, 0, sizeof(*r));
+}
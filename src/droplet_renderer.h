@@ -0,0 +1,60 @@
+#ifndef DROPLET_RENDERER_H
+#define DROPLET_RENDERER_H
+
+#include <stdbool.h>
+#include "shader_utils.h"
+#include "state.h"
+
+// Number of buffer regions cycled through so the CPU never writes a region the GPU is still reading.
+#define DROPLET_RENDER_REGIONS 3
+
+// Draws a whole droplet population with one GL_POINTS call and one glMultiDrawArrays
+// call for all trails. Positions live in SoA planes of a single buffer:
+// point x | point y | point z | trail x | trail y | trail z, each plane split
+// into DROPLET_RENDER_REGIONS regions. Points and trails use separate VAOs
+// over the same buffer.
+struct DropletRenderer
+{
+    struct ShaderProgram program;
+    int program_generation; // generation whose static uniforms have been set
+
+    GLuint vbo;
+    GLuint point_vao, trail_vao;
+
+    // Persistently mapped point and trail planes (both inside one mapping), or
+    // NULL when GL_ARB_buffer_storage is unavailable and uploads fall back to
+    // glBufferSubData.
+    float *point_map;
+    float *trail_map;
+    GLsync fences[DROPLET_RENDER_REGIONS];
+    int region;
+
+    // CPU staging planes for the fallback path.
+    float *point_staging;
+    float *trail_staging;
+
+    // Per-trail offsets/counts handed to glMultiDrawArrays.
+    GLint *trail_first;
+    GLsizei *trail_count;
+
+    int capacity;       // max droplets per frame
+    int trail_capacity; // max trail vertices per frame
+
+    // Subsampling: draw every point_stride-th droplet, the trail of every
+    // trail_stride-th droplet, and every trail_step-th sample along each trail.
+    int point_stride;
+    int trail_stride;
+    int trail_step;
+    float point_size;
+};
+
+// Create GL objects for up to max_droplets droplets. Returns false on failure.
+bool dropletRendererInit(struct DropletRenderer *r, int max_droplets);
+
+// Upload and draw the droplets and their trails. Leaves the droplet program bound.
+// The caller may hot-reload r->program between draws.
+void dropletRendererDraw(struct DropletRenderer *r, const struct Droplet *droplets, int count, const float *mvp);
+
+void dropletRendererDestroy(struct DropletRenderer *r);
+
+#endif // DROPLET_RENDERER_H
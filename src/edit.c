@@ -0,0 +1,83 @@
+#include "edit.h"
+#include <math.h>
+#include "gen.h"
+
+// Brush falloff: 1 at the center, smoothly down to 0 at the rim.
+static float brushWeight(float dist, float radius)
+{
+    float t = 1.0f - dist / radius;
+    return t > 0.0f ? t * t : 0.0f;
+}
+
+void applyBrush(struct State *state, float x, float z)
+{
+    const struct Brush *brush = &state->brush;
+    if (brush->tool == BRUSH_RAIN)
+    {
+        spawnRainBurst(state, x, z, brush->radius, brush->burst_droplets);
+        return;
+    }
+
+    const float cellsPerUnit = 0.5f * (GRID_SIZE - 1);
+    int cx = (int)((x + 1.0f) * cellsPerUnit + 0.5f);
+    int cz = (int)((z + 1.0f) * cellsPerUnit + 0.5f);
+    int r = (int)ceilf(brush->radius * cellsPerUnit);
+
+    struct CellRect region;
+    region.x0 = cx - r < 0 ? 0 : cx - r;
+    region.z0 = cz - r < 0 ? 0 : cz - r;
+    region.x1 = cx + r > GRID_SIZE - 1 ? GRID_SIZE - 1 : cx + r;
+    region.z1 = cz + r > GRID_SIZE - 1 ? GRID_SIZE - 1 : cz + r;
+    region.valid = region.x0 <= region.x1 && region.z0 <= region.z1;
+    if (!region.valid)
+        return;
+
+    // Heights before the edit, in frame scratch: smoothing reads its neighbours
+    // from them and relaxRegion compares the new slopes against them.
+    struct HeightPatch before;
+    if (!saveHeightPatch(state, region, &state->frame_arena, &before))
+        return;
+
+    for (int i = region.x0; i <= region.x1; i++)
+    {
+        for (int j = region.z0; j <= region.z1; j++)
+        {
+            float wx = (float)i / cellsPerUnit - 1.0f - x;
+            float wz = (float)j / cellsPerUnit - 1.0f - z;
+            float w = brushWeight(sqrtf(wx * wx + wz * wz), brush->radius);
+            if (w <= 0.0f)
+                continue;
+
+            float delta;
+            if (brush->tool == BRUSH_RAISE)
+            {
+                delta = brush->strength * w;
+            }
+            else if (brush->tool == BRUSH_LOWER)
+            {
+                delta = -brush->strength * w;
+            }
+            else
+            {
+                float sum = 0.0f;
+                int n = 0;
+                for (int di = -1; di <= 1; di++)
+                {
+                    for (int dj = -1; dj <= 1; dj++)
+                    {
+                        if (i + di < 0 || i + di >= GRID_SIZE || j + dj < 0 || j + dj >= GRID_SIZE)
+                            continue;
+                        sum += patchHeight(&before, i + di, j + dj);
+                        n++;
+                    }
+                }
+                delta = (sum / n - patchHeight(&before, i, j)) * fminf(1.0f, w * 4.0f);
+            }
+            setCellHeight(state, i, j, state->grid[i][j] + delta);
+        }
+    }
+
+    markDirty(state, region.x0, region.z0, region.x1, region.z1);
+    // Re-settle only the edited patch, and only where the edit steepened it.
+    relaxRegion(state, region, &before);
+}
@@ -0,0 +1,10 @@
+#ifndef EDIT_H
+#define EDIT_H
+
+#include "state.h"
+
+// Apply state->brush for one frame centered at world position (x,z). Only the
+// cells under the brush are changed, relaxed and marked dirty.
+void applyBrush(struct State *state, float x, float z);
+
+#endif // EDIT_H
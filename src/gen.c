@@ -1,7 +1,22 @@
 #include "gen.h"
 #include <math.h>
 #include <stdlib.h>
-#include "util.h" // for rand_range()
+#include <string.h>
+#include "jobs.h"
+#include "wind.h"
+#include "util.h" // for rng_range()
+
+// Kernels are written once as an always-inlined body taking feature flags;
+// each wrapper passes compile-time constants so the compiler folds the flag
+// checks away and emits a branch-free specialization.
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+#define MAX_SPECIALIZED_BRUSH 3
+#define DROPLET_GRAIN 256 // droplets per parallel_for piece
 
 static float clampf(float v, float minVal, float maxVal)
 {
@@ -14,17 +29,71 @@ static float clampf(float v, float minVal, float maxVal)
 
 void initDroplet(struct Droplet *d)
 {
-    d->x = rand_range(-1.0f, 1.0f);
-    d->z = rand_range(-1.0f, 1.0f);
+    d->x = rng_range(&d->rng, -1.0f, 1.0f);
+    d->z = rng_range(&d->rng, -1.0f, 1.0f);
     d->y = 2.0f;
     d->water = 1.0f;
     d->sediment = 0.0f;
     d->speed = 0.0f;
+    d->dir_x = 0.0f;
+    d->dir_z = 0.0f;
+    d->deposit_amount = 0.0f;
     d->active = true;
     d->trail_count = 0;
     d->stagnant_steps = 0; // initialize counter
 }
 
+void seedDroplets(struct State *state, uint32_t seed)
+{
+    state->seed = seed;
+    for (int i = 0; i < state->droplet_count; i++)
+    {
+        state->droplets[i].rng = rng_seed(seed, (uint32_t)i);
+        initDroplet(&state->droplets[i]);
+    }
+}
+
+void setRain(struct State *state, bool enabled)
+{
+    // The rain kernels assume every droplet is active: respawn the retired ones.
+    if (enabled && !state->params.rain_enabled)
+    {
+        for (int i = 0; i < state->droplet_count; i++)
+        {
+            if (!state->droplets[i].active)
+                initDroplet(&state->droplets[i]);
+        }
+    }
+    state->params.rain_enabled = enabled;
+}
+
+struct StepTask
+{
+    DropletStepFn step;
+    struct State *state;
+};
+
+static void stepDropletRange(void *ctx, int begin, int end)
+{
+    struct StepTask *task = ctx;
+    task->step(task->state, begin, end);
+}
+
+// Droplets step in parallel (each only reads the grid and writes itself);
+// the apply pass then writes the grid serially in index order, so the result
+// is bit-identical for any worker count.
+void stepSimulation(struct State *state)
+{
+    arena_reset(&state->sim_arena);
+    struct DropletKernel kernel = selectDropletKernel(&state->params);
+    struct StepTask task = {kernel.step, state};
+    jobs_parallel_for(0, state->droplet_count, DROPLET_GRAIN, stepDropletRange, &task);
+    kernel.apply(state);
+
+    if (state->params.wind_enabled)
+        windErosionPass(state);
+}
+
 float getHeight(struct State *state, float x, float z)
 {
     float fx = (x + 1.0f) * 0.5f * (GRID_SIZE - 1);
@@ -54,47 +123,343 @@ void getGradient(struct State *state, float x, float z, float *gradX, float *gra
     *gradZ = (hZplus - hZminus) / (2.0f * eps);
 }
 
-void modifyHeight(struct State *state, float x, float z, float amount)
+// Bilinear height and its analytic gradient (world units) at (x,z).
+static float getHeightBilinear(struct State *state, float x, float z, float *gradX, float *gradZ)
 {
-    float fx = (x + 1.0f) * 0.5f * (GRID_SIZE - 1);
-    float fz = (z + 1.0f) * 0.5f * (GRID_SIZE - 1);
+    const float cellsPerUnit = 0.5f * (GRID_SIZE - 1);
+    float fx = clampf((x + 1.0f) * cellsPerUnit, 0.0f, (float)(GRID_SIZE - 1));
+    float fz = clampf((z + 1.0f) * cellsPerUnit, 0.0f, (float)(GRID_SIZE - 1));
     int ix = (int)fx;
     int iz = (int)fz;
+    if (ix > GRID_SIZE - 2)
+        ix = GRID_SIZE - 2;
+    if (iz > GRID_SIZE - 2)
+        iz = GRID_SIZE - 2;
+    float tx = fx - ix;
+    float tz = fz - iz;
+
+    float h00 = state->grid[ix][iz];
+    float h10 = state->grid[ix + 1][iz];
+    float h01 = state->grid[ix][iz + 1];
+    float h11 = state->grid[ix + 1][iz + 1];
+
+    if (gradX)
+    {
+        *gradX = ((h10 - h00) * (1.0f - tz) + (h11 - h01) * tz) * cellsPerUnit;
+        *gradZ = ((h01 - h00) * (1.0f - tx) + (h11 - h10) * tx) * cellsPerUnit;
+    }
+    return (h00 * (1.0f - tx) + h10 * tx) * (1.0f - tz) + (h01 * (1.0f - tx) + h11 * tx) * tz;
+}
+
+// Remove up to `effort` of material from the top of a cell, layer by layer: each
+// layer yields effort * its erodibility until it is used up, then the rest of
+// the effort moves on to the layer below. Returns the height actually removed.
+static float erodeCell(struct State *state, int ix, int iz, float effort)
+{
+    const struct ErosionParams *p = &state->params;
+    float h = state->grid[ix][iz];
+    float soilTop = dequantizeElevation(state->soil_top[ix][iz]);
+    float rockTop = dequantizeElevation(state->bedrock_top[ix][iz]);
+    const float floors[3] = {soilTop, rockTop, 0.0f};
+    const float erodibility[3] = {p->erodibility_sediment, p->erodibility_soil, p->erodibility_bedrock};
+
+    float start = h;
+    for (int layer = 0; layer < 3 && effort > 0.0f; layer++)
+    {
+        float available = h - floors[layer];
+        if (available <= 0.0f || erodibility[layer] <= 0.0f)
+            continue;
+        float take = fminf(available, effort * erodibility[layer]);
+        h -= take;
+        effort -= take / erodibility[layer];
+    }
+
+    // Interfaces follow the surface down once it cuts into them.
+    state->grid[ix][iz] = h;
+    if (h < soilTop)
+        state->soil_top[ix][iz] = quantizeElevation(h);
+    if (h < rockTop)
+        state->bedrock_top[ix][iz] = quantizeElevation(h);
+    return start - h;
+}
+
+float addCellHeight(struct State *state, int ix, int iz, float amount)
+{
+    if (ix < 0 || ix >= GRID_SIZE)
+        return 0.0f;
+    if (iz < 0 || iz >= GRID_SIZE)
+        return 0.0f;
+
+    if (amount < 0.0f)
+        return -erodeCell(state, ix, iz, -amount);
+
+    // Deposits always land as sediment on top.
+    float h = state->grid[ix][iz];
+    float raised = fminf(h + amount, 2.0f);
+    state->grid[ix][iz] = raised;
+    return raised - h;
+}
+
+void setCellHeight(struct State *state, int ix, int iz, float h)
+{
     if (ix < 0 || ix >= GRID_SIZE)
         return;
     if (iz < 0 || iz >= GRID_SIZE)
         return;
 
-    state->grid[ix][iz] += amount;
-    if (state->grid[ix][iz] < 0.0f)
-        state->grid[ix][iz] = 0.0f;
-    if (state->grid[ix][iz] > 2.0f)
-        state->grid[ix][iz] = 2.0f;
+    h = clampf(h, 0.0f, 2.0f);
+    state->grid[ix][iz] = h;
+    uint16_t q = quantizeElevation(h);
+    if (state->soil_top[ix][iz] > q)
+        state->soil_top[ix][iz] = q;
+    if (state->bedrock_top[ix][iz] > q)
+        state->bedrock_top[ix][iz] = q;
 }
 
-// const for horizontal speed
-#define HORIZONTAL_SPEED 0.01f
-#define FIXED_SLIDE_STEP 0.001f
+void modifyHeight(struct State *state, float x, float z, float amount)
+{
+    float fx = (x + 1.0f) * 0.5f * (GRID_SIZE - 1);
+    float fz = (z + 1.0f) * 0.5f * (GRID_SIZE - 1);
+    addCellHeight(state, (int)fx, (int)fz, amount);
+}
 
-// Updated updateDroplet: no erosion; droplet simply falls with gravity and a slight horizontal drift.
-// Also updates its trail.
-void updateDroplet(struct Droplet *d, struct State *state)
+bool raycastTerrain(struct State *state, const float origin[3], const float dir[3], float *hitX, float *hitZ)
 {
-    // Out-of-bounds check.
-    if (d->x < -1.0f || d->x > 1.0f || d->z < -1.0f || d->z > 1.0f)
+    // Clip the ray to the terrain's bounding box [-1,1] x [0,2] x [-1,1].
+    const float lo[3] = {-1.0f, 0.0f, -1.0f};
+    const float hi[3] = {1.0f, 2.0f, 1.0f};
+    float tmin = 0.0f, tmax = 1e30f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (fabsf(dir[axis]) < 1e-9f)
+        {
+            if (origin[axis] < lo[axis] || origin[axis] > hi[axis])
+                return false;
+            continue;
+        }
+        float t0 = (lo[axis] - origin[axis]) / dir[axis];
+        float t1 = (hi[axis] - origin[axis]) / dir[axis];
+        if (t0 > t1)
+        {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        tmin = fmaxf(tmin, t0);
+        tmax = fminf(tmax, t1);
+    }
+    if (tmin > tmax)
+        return false;
+
+    // March in half-cell steps until the ray dips below the surface, then bisect.
+    float dirLen = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    float step = (1.0f / (GRID_SIZE - 1)) / dirLen;
+    float prev = tmin;
+    for (float t = tmin; t <= tmax + step; t += step)
+    {
+        float tc = fminf(t, tmax);
+        float y = origin[1] + dir[1] * tc;
+        float h = getHeightBilinear(state, origin[0] + dir[0] * tc, origin[2] + dir[2] * tc, NULL, NULL);
+        if (y <= h)
+        {
+            float a = prev, b = tc;
+            for (int i = 0; i < 16; i++)
+            {
+                float mid = 0.5f * (a + b);
+                float my = origin[1] + dir[1] * mid;
+                if (my <= getHeightBilinear(state, origin[0] + dir[0] * mid, origin[2] + dir[2] * mid, NULL, NULL))
+                    b = mid;
+                else
+                    a = mid;
+            }
+            *hitX = origin[0] + dir[0] * b;
+            *hitZ = origin[2] + dir[2] * b;
+            return true;
+        }
+        prev = tc;
+    }
+    return false;
+}
+
+void spawnRainBurst(struct State *state, float x, float z, float radius, int count)
+{
+    const struct ErosionParams *p = &state->params;
+    for (int n = 0; n < count && state->droplet_count > 0; n++)
     {
+        // Prefer retired droplets; otherwise recycle round-robin.
+        int index = state->burst_cursor;
+        for (int probe = 0; probe < state->droplet_count; probe++)
+        {
+            int candidate = (state->burst_cursor + probe) % state->droplet_count;
+            if (!state->droplets[candidate].active)
+            {
+                index = candidate;
+                break;
+            }
+        }
+        state->burst_cursor = (index + 1) % state->droplet_count;
+
+        struct Droplet *d = &state->droplets[index];
         initDroplet(d);
+        float angle = rng_range(&d->rng, 0.0f, 6.2831853f);
+        float r = radius * sqrtf(rng_range(&d->rng, 0.0f, 1.0f));
+        d->x = clampf(x + cosf(angle) * r, -1.0f, 1.0f);
+        d->z = clampf(z + sinf(angle) * r, -1.0f, 1.0f);
+        // Start on the surface so the burst erodes right away.
+        d->y = getHeight(state, d->x, d->z) + p->surface_offset;
+    }
+}
+
+bool saveHeightPatch(struct State *state, struct CellRect region, struct Arena *arena, struct HeightPatch *patch)
+{
+    patch->x0 = region.x0 - RELAX_MARGIN > 0 ? region.x0 - RELAX_MARGIN : 0;
+    patch->z0 = region.z0 - RELAX_MARGIN > 0 ? region.z0 - RELAX_MARGIN : 0;
+    patch->x1 = region.x1 + RELAX_MARGIN < GRID_SIZE - 1 ? region.x1 + RELAX_MARGIN : GRID_SIZE - 1;
+    patch->z1 = region.z1 + RELAX_MARGIN < GRID_SIZE - 1 ? region.z1 + RELAX_MARGIN : GRID_SIZE - 1;
+    int cols = patch->z1 - patch->z0 + 1;
+    patch->heights = arena_alloc(arena, sizeof(float) * (patch->x1 - patch->x0 + 1) * cols, 64);
+    if (!patch->heights)
+        return false;
+    for (int x = patch->x0; x <= patch->x1; x++)
+        memcpy(&patch->heights[(x - patch->x0) * cols], &state->grid[x][patch->z0], sizeof(float) * cols);
+    return true;
+}
+
+void relaxRegion(struct State *state, struct CellRect region, const struct HeightPatch *before)
+{
+    if (!region.valid)
         return;
+    const struct ErosionParams *p = &state->params;
+    const float maxDrop = p->talus_slope * (2.0f / (GRID_SIZE - 1));
+    const int dx[4] = {1, -1, 0, 0};
+    const int dz[4] = {0, 0, 1, -1};
+
+    // Grow by one cell so the rim of the region can slump outwards too.
+    // Its neighbours are still inside the saved patch.
+    int x0 = region.x0 > 0 ? region.x0 - 1 : 0;
+    int z0 = region.z0 > 0 ? region.z0 - 1 : 0;
+    int x1 = region.x1 < GRID_SIZE - 1 ? region.x1 + 1 : GRID_SIZE - 1;
+    int z1 = region.z1 < GRID_SIZE - 1 ? region.z1 + 1 : GRID_SIZE - 1;
+
+    for (int iter = 0; iter < p->relax_iterations; iter++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            for (int z = z0; z <= z1; z++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    int nx = x + dx[k], nz = z + dz[k];
+                    if (nx < 0 || nx >= GRID_SIZE || nz < 0 || nz >= GRID_SIZE)
+                        continue;
+                    // The edit may steepen a pair by up to the talus drop on top of
+                    // the downhill drop it already had; only the rest slumps.
+                    float previous = patchHeight(before, x, z) - patchHeight(before, nx, nz);
+                    float allowed = maxDrop + fmaxf(previous, 0.0f);
+                    float excess = state->grid[x][z] - state->grid[nx][nz] - allowed;
+                    if (excess <= 0.0f)
+                        continue;
+                    // Move half the excess downhill; whatever the layers release lands next door.
+                    float moved = -addCellHeight(state, x, z, -0.5f * excess);
+                    addCellHeight(state, nx, nz, moved);
+                }
+            }
+        }
     }
+    markDirty(state, x0 - 1, z0 - 1, x1 + 1, z1 + 1);
+}
 
-    const float dt = 0.016f; // ~60 FPS timestep
-    const float gravity = 9.8f;
-    const float threshold = 0.05f; // free-fall threshold
-    const float offset = 0.05f;    // droplet offset above mesh
+static void recordTrail(struct Droplet *d)
+{
+    if (d->trail_count < TRAIL_LENGTH)
+    {
+        d->trail[d->trail_count][0] = d->x;
+        d->trail[d->trail_count][1] = d->y;
+        d->trail[d->trail_count][2] = d->z;
+        d->trail_count++;
+    }
+    else
+    {
+        for (int i = 0; i < TRAIL_LENGTH - 1; i++)
+        {
+            d->trail[i][0] = d->trail[i + 1][0];
+            d->trail[i][1] = d->trail[i + 1][1];
+            d->trail[i][2] = d->trail[i + 1][2];
+        }
+        d->trail[TRAIL_LENGTH - 1][0] = d->x;
+        d->trail[TRAIL_LENGTH - 1][1] = d->y;
+        d->trail[TRAIL_LENGTH - 1][2] = d->z;
+    }
+}
+
+// True if the full trail fits in a tiny bounding box (droplet stuck in a loop/cavity).
+static bool trailIsStuck(const struct Droplet *d)
+{
+    if (d->trail_count < TRAIL_LENGTH)
+        return false;
+
+    float minX = d->trail[0][0], maxX = d->trail[0][0];
+    float minY = d->trail[0][1], maxY = d->trail[0][1];
+    float minZ = d->trail[0][2], maxZ = d->trail[0][2];
+    for (int i = 1; i < TRAIL_LENGTH; i++)
+    {
+        if (d->trail[i][0] < minX)
+            minX = d->trail[i][0];
+        if (d->trail[i][0] > maxX)
+            maxX = d->trail[i][0];
+        if (d->trail[i][1] < minY)
+            minY = d->trail[i][1];
+        if (d->trail[i][1] > maxY)
+            maxY = d->trail[i][1];
+        if (d->trail[i][2] < minZ)
+            minZ = d->trail[i][2];
+        if (d->trail[i][2] > maxZ)
+            maxZ = d->trail[i][2];
+    }
+    float dx = maxX - minX;
+    float dy = maxY - minY;
+    float dz = maxZ - minZ;
+    const float cavityThreshold = 0.005f;
+    return dx < cavityThreshold && dy < cavityThreshold && dz < cavityThreshold;
+}
+
+// Respawn a droplet that is done, or retire it while rain is off.
+KERNEL_INLINE void finishDroplet(struct Droplet *d, const bool rain)
+{
+    if (rain)
+        initDroplet(d);
+    else
+        d->active = false;
+}
+
+// One droplet step. Reads the grid only: the resulting height change is left in
+// deposit_* and written by the apply pass, so droplets can be stepped in any order.
+// With rain on every droplet is active (see setRain), so only the rain-off
+// variants check for retired droplets.
+KERNEL_INLINE void stepDropletImpl(struct Droplet *d, struct State *state, const struct ErosionParams *p,
+                                   const bool rain, const bool trail, const bool bilinear, const bool inertia)
+{
+    d->deposit_amount = 0.0f;
+    if (!rain && !d->active)
+        return;
+
+    // Out-of-bounds check.
+    if (d->x < -1.0f || d->x > 1.0f || d->z < -1.0f || d->z > 1.0f)
+    {
+        finishDroplet(d, rain);
+        return;
+    }
 
-    float terrainY = getHeight(state, d->x, d->z);
-    float gx, gz;
-    getGradient(state, d->x, d->z, &gx, &gz);
+    float terrainY, gx, gz;
+    if (bilinear)
+    {
+        terrainY = getHeightBilinear(state, d->x, d->z, &gx, &gz);
+    }
+    else
+    {
+        terrainY = getHeight(state, d->x, d->z);
+        getGradient(state, d->x, d->z, &gx, &gz);
+    }
     float gradLen = sqrtf(gx * gx + gz * gz);
     if (gradLen > 1e-6f)
     {
@@ -115,72 +480,184 @@ void updateDroplet(struct Droplet *d, struct State *state)
     // If droplet is stuck for too many steps, reset it.
     if (d->stagnant_steps > MAX_STAGNANT_STEPS)
     {
-        initDroplet(d);
+        finishDroplet(d, rain);
         return;
     }
 
-    if (d->y > terrainY + threshold)
+    // Travel direction: downhill, optionally blended with the previous heading.
+    float dirX = -gx, dirZ = -gz;
+    if (inertia)
+    {
+        dirX = d->dir_x * p->inertia - gx * (1.0f - p->inertia);
+        dirZ = d->dir_z * p->inertia - gz * (1.0f - p->inertia);
+        float dirLen = sqrtf(dirX * dirX + dirZ * dirZ);
+        if (dirLen > 1e-6f)
+        {
+            dirX /= dirLen;
+            dirZ /= dirLen;
+        }
+        d->dir_x = dirX;
+        d->dir_z = dirZ;
+    }
+
+    if (d->y > terrainY + p->fall_threshold)
     {
         // Free-fall.
-        d->y -= gravity * dt;
-        d->x -= gx * HORIZONTAL_SPEED * dt;
-        d->z -= gz * HORIZONTAL_SPEED * dt;
+        d->y -= p->gravity * p->dt;
+        d->x += dirX * p->horizontal_speed * p->dt;
+        d->z += dirZ * p->horizontal_speed * p->dt;
     }
     else
     {
-        // Slide along the mesh using a fixed step.
-        d->y = terrainY + offset;
-        d->x -= gx * FIXED_SLIDE_STEP;
-        d->z -= gz * FIXED_SLIDE_STEP;
+        // Slide along the mesh using a fixed step, eroding or depositing where it left.
+        float oldX = d->x, oldZ = d->z;
+        d->y = terrainY + p->surface_offset;
+        d->x += dirX * p->slide_step;
+        d->z += dirZ * p->slide_step;
+
+        float newY = bilinear ? getHeightBilinear(state, d->x, d->z, NULL, NULL) : getHeight(state, d->x, d->z);
+        float dh = newY - terrainY;
+        float capacity = fmaxf(-dh, p->min_slope) * d->speed * d->water * p->capacity;
+
+        float amount;
+        if (dh > 0.0f)
+            amount = fminf(dh, d->sediment); // fill the pit we climbed into
+        else if (d->sediment > capacity)
+            amount = (d->sediment - capacity) * p->deposit_rate;
+        else
+            amount = -fminf((capacity - d->sediment) * p->erode_rate, -dh);
+
+        d->sediment -= amount;
+        d->deposit_x = oldX;
+        d->deposit_z = oldZ;
+        d->deposit_amount = amount;
+        d->speed = sqrtf(fmaxf(0.0f, d->speed * d->speed - dh * p->gravity));
     }
 
-    // Update trail.
-    if (d->trail_count < TRAIL_LENGTH)
+    if (trail)
     {
-        d->trail[d->trail_count][0] = d->x;
-        d->trail[d->trail_count][1] = d->y;
-        d->trail[d->trail_count][2] = d->z;
-        d->trail_count++;
+        recordTrail(d);
+        if (trailIsStuck(d))
+            finishDroplet(d, rain);
     }
-    else
+}
+
+KERNEL_INLINE void stepDropletsImpl(struct State *state, int begin, int end,
+                                    const bool rain, const bool trail, const bool bilinear, const bool inertia)
+{
+    const struct ErosionParams params = state->params;
+    struct Droplet *droplets = state->droplets;
+    for (int i = begin; i < end; i++)
+        stepDropletImpl(&droplets[i], state, &params, rain, trail, bilinear, inertia);
+}
+
+// Write every droplet's pending height change through a brush of the given radius,
+// in droplet index order so the result doesn't depend on how stepping was split up.
+KERNEL_INLINE void applyDepositsImpl(struct State *state, const int radius)
+{
+    // Cone weights, normalized over the full footprint, built once per pass in pass scratch.
+    const int width = 2 * radius + 1;
+    float *weights = arena_alloc(&state->sim_arena, sizeof(float) * width * width, 64);
+    if (!weights)
+        return;
+    float norm = 0.0f;
+    for (int dx = -radius; dx <= radius; dx++)
     {
-        for (int i = 0; i < TRAIL_LENGTH - 1; i++)
+        for (int dz = -radius; dz <= radius; dz++)
         {
-            d->trail[i][0] = d->trail[i + 1][0];
-            d->trail[i][1] = d->trail[i + 1][1];
-            d->trail[i][2] = d->trail[i + 1][2];
+            float w = fmaxf(0.0f, (float)(radius + 1) - sqrtf((float)(dx * dx + dz * dz)));
+            weights[(dx + radius) * width + (dz + radius)] = w;
+            norm += w;
         }
-        d->trail[TRAIL_LENGTH - 1][0] = d->x;
-        d->trail[TRAIL_LENGTH - 1][1] = d->y;
-        d->trail[TRAIL_LENGTH - 1][2] = d->z;
     }
+    for (int k = 0; k < width * width; k++)
+        weights[k] /= norm;
 
-    // Optional: Check if the trail's bounding box is extremely small (indicating a loop/cavity).
-    if (d->trail_count == TRAIL_LENGTH)
+    struct Droplet *droplets = state->droplets;
+    for (int i = 0; i < state->droplet_count; i++)
     {
-        float minX = d->trail[0][0], maxX = d->trail[0][0];
-        float minY = d->trail[0][1], maxY = d->trail[0][1];
-        float minZ = d->trail[0][2], maxZ = d->trail[0][2];
-        for (int i = 1; i < TRAIL_LENGTH; i++)
+        float amount = droplets[i].deposit_amount;
+        if (amount == 0.0f)
+            continue;
+        int cx = (int)((droplets[i].deposit_x + 1.0f) * 0.5f * (GRID_SIZE - 1));
+        int cz = (int)((droplets[i].deposit_z + 1.0f) * 0.5f * (GRID_SIZE - 1));
+        // Each footprint dirties only its own mesh tiles.
+        markDirty(state, cx - radius, cz - radius, cx + radius, cz + radius);
+        for (int dx = -radius; dx <= radius; dx++)
         {
-            if (d->trail[i][0] < minX)
-                minX = d->trail[i][0];
-            if (d->trail[i][0] > maxX)
-                maxX = d->trail[i][0];
-            if (d->trail[i][1] < minY)
-                minY = d->trail[i][1];
-            if (d->trail[i][1] > maxY)
-                maxY = d->trail[i][1];
-            if (d->trail[i][2] < minZ)
-                minZ = d->trail[i][2];
-            if (d->trail[i][2] > maxZ)
-                maxZ = d->trail[i][2];
+            for (int dz = -radius; dz <= radius; dz++)
+            {
+                float requested = amount * weights[(dx + radius) * width + (dz + radius)];
+                float applied = addCellHeight(state, cx + dx, cz + dz, requested);
+                // Hard layers, the height limit or the map edge may take less than asked:
+                // the droplet keeps whatever wasn't actually moved.
+                droplets[i].sediment += requested - applied;
+            }
         }
-        float dx = maxX - minX;
-        float dy = maxY - minY;
-        float dz = maxZ - minZ;
-        const float cavityThreshold = 0.005f;
-        if (dx < cavityThreshold && dy < cavityThreshold && dz < cavityThreshold)
-            initDroplet(d);
     }
 }
+
+// Step variants: every combination of rain / trail / bilinear / inertia.
+#define DEFINE_STEP_KERNEL(R, T, B, I)                                                         \
+    static void stepDroplets_r##R##_t##T##_b##B##_i##I(struct State *state, int begin, int end) \
+    {                                                                                          \
+        stepDropletsImpl(state, begin, end, R, T, B, I);                                       \
+    }
+
+DEFINE_STEP_KERNEL(0, 0, 0, 0)
+DEFINE_STEP_KERNEL(0, 0, 0, 1)
+DEFINE_STEP_KERNEL(0, 0, 1, 0)
+DEFINE_STEP_KERNEL(0, 0, 1, 1)
+DEFINE_STEP_KERNEL(0, 1, 0, 0)
+DEFINE_STEP_KERNEL(0, 1, 0, 1)
+DEFINE_STEP_KERNEL(0, 1, 1, 0)
+DEFINE_STEP_KERNEL(0, 1, 1, 1)
+DEFINE_STEP_KERNEL(1, 0, 0, 0)
+DEFINE_STEP_KERNEL(1, 0, 0, 1)
+DEFINE_STEP_KERNEL(1, 0, 1, 0)
+DEFINE_STEP_KERNEL(1, 0, 1, 1)
+DEFINE_STEP_KERNEL(1, 1, 0, 0)
+DEFINE_STEP_KERNEL(1, 1, 0, 1)
+DEFINE_STEP_KERNEL(1, 1, 1, 0)
+DEFINE_STEP_KERNEL(1, 1, 1, 1)
+
+static const DropletStepFn stepKernels[2][2][2][2] = {
+    {{{stepDroplets_r0_t0_b0_i0, stepDroplets_r0_t0_b0_i1}, {stepDroplets_r0_t0_b1_i0, stepDroplets_r0_t0_b1_i1}},
+     {{stepDroplets_r0_t1_b0_i0, stepDroplets_r0_t1_b0_i1}, {stepDroplets_r0_t1_b1_i0, stepDroplets_r0_t1_b1_i1}}},
+    {{{stepDroplets_r1_t0_b0_i0, stepDroplets_r1_t0_b0_i1}, {stepDroplets_r1_t0_b1_i0, stepDroplets_r1_t0_b1_i1}},
+     {{stepDroplets_r1_t1_b0_i0, stepDroplets_r1_t1_b0_i1}, {stepDroplets_r1_t1_b1_i0, stepDroplets_r1_t1_b1_i1}}},
+};
+
+// Apply variants: fixed brush radii 0..MAX_SPECIALIZED_BRUSH, plus a generic fallback.
+#define DEFINE_APPLY_KERNEL(R)                         \
+    static void applyDeposits_r##R(struct State *state) \
+    {                                                  \
+        applyDepositsImpl(state, R);                   \
+    }
+
+DEFINE_APPLY_KERNEL(0)
+DEFINE_APPLY_KERNEL(1)
+DEFINE_APPLY_KERNEL(2)
+DEFINE_APPLY_KERNEL(3)
+
+static void applyDeposits_generic(struct State *state)
+{
+    applyDepositsImpl(state, state->params.brush_radius);
+}
+
+static const DropletApplyFn applyKernels[MAX_SPECIALIZED_BRUSH + 1] = {
+    applyDeposits_r0, applyDeposits_r1, applyDeposits_r2, applyDeposits_r3};
+
+struct DropletKernel selectDropletKernel(const struct ErosionParams *params)
+{
+    struct DropletKernel kernel;
+    kernel.step =
+        stepKernels[params->rain_enabled][params->record_trail][params->bilinear][params->inertia > 0.0f];
+    if (params->brush_radius <= 0)
+        kernel.apply = applyKernels[0];
+    else if (params->brush_radius <= MAX_SPECIALIZED_BRUSH)
+        kernel.apply = applyKernels[params->brush_radius];
+    else
+        kernel.apply = applyDeposits_generic;
+    return kernel;
+}
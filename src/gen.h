@@ -3,11 +3,32 @@
 
 #include "state.h"
 
+// Give every droplet its own random stream derived from seed, then spawn it.
+void seedDroplets(struct State *state, uint32_t seed);
+
+// Switch global rain. Turning it back on respawns every retired droplet.
+void setRain(struct State *state, bool enabled);
+
+// Advance every droplet by one step (one frame of simulation).
+void stepSimulation(struct State *state);
+
 // Spawn or reset a droplet above the terrain.
 void initDroplet(struct Droplet *d);
 
-// Update droplet movement/erosion for one step.
-void updateDroplet(struct Droplet *d, struct State *state);
+// Step droplets [begin, end): movement plus the erosion/deposition they want to apply.
+typedef void (*DropletStepFn)(struct State *state, int begin, int end);
+// Write the pending height changes of all droplets to the grid.
+typedef void (*DropletApplyFn)(struct State *state);
+
+struct DropletKernel
+{
+    DropletStepFn step;
+    DropletApplyFn apply;
+};
+
+// Pick the variant specialized for params' feature flags (rain, trail,
+// sampling, inertia, brush radius). Radii above 3 fall back to a generic brush.
+struct DropletKernel selectDropletKernel(const struct ErosionParams *params);
 
 // Helper: get terrain height at floating coords (x,z).
 float getHeight(struct State *state, float x, float z);
@@ -15,7 +36,48 @@ float getHeight(struct State *state, float x, float z);
 // Helper: get partial derivatives at (x,z).
 void getGradient(struct State *state, float x, float z, float *gradX, float *gradZ);
 
+// Helper: change cell (ix,iz) by amount. Negative amounts erode through the
+// terrain layers (scaled by each layer's erodibility), positive amounts deposit
+// sediment up to the height limit. Returns the change actually applied
+// (0 for cells outside the grid).
+float addCellHeight(struct State *state, int ix, int iz, float amount);
+
+// Helper: set cell (ix,iz) to height h directly, ignoring erodibility. Layers
+// above the new surface are cut away; anything added counts as sediment.
+void setCellHeight(struct State *state, int ix, int iz, float h);
+
 // Helper: modify height around (x,z).
 void modifyHeight(struct State *state, float x, float z, float amount);
 
+// Intersect a ray with the heightmap. Returns false if it misses the terrain.
+bool raycastTerrain(struct State *state, const float origin[3], const float dir[3], float *hitX, float *hitZ);
+
+// Drop count droplets on the surface inside a disc, reusing retired droplets first.
+void spawnRainBurst(struct State *state, float x, float z, float radius, int count);
+
+// Heights around an edited region (grown by RELAX_MARGIN cells, clamped to the
+// grid), saved before the edit so relaxRegion can tell slopes the edit added
+// from the terrain's own.
+#define RELAX_MARGIN 2
+struct HeightPatch
+{
+    float *heights; // rows x0..x1 of z1 - z0 + 1 heights each
+    int x0, z0, x1, z1;
+};
+
+// Copy the heights around region into arena scratch. Returns false if it doesn't fit.
+bool saveHeightPatch(struct State *state, struct CellRect region, struct Arena *arena, struct HeightPatch *patch);
+
+static inline float patchHeight(const struct HeightPatch *patch, int x, int z)
+{
+    return patch->heights[(x - patch->x0) * (patch->z1 - patch->z0 + 1) + (z - patch->z0)];
+}
+
+// Let slopes in region (plus a one-cell rim) that one edit steepened by more
+// than the talus slope slump back. Slope is measured against before (the patch
+// saved by saveHeightPatch), so untouched terrain keeps its shape, a brush held
+// over many frames builds relief at its own pace, and the rest of the map is
+// never visited.
+void relaxRegion(struct State *state, struct CellRect region, const struct HeightPatch *before);
+
 #endif // GEN_H
@@ -2,12 +2,41 @@
 #include <SDL2/SDL.h>
 #include <stdio.h>
 #include <math.h>
+#include "edit.h"
+#include "gen.h"
+#include "matrix.h"
+
+// Cast the mouse cursor into the scene using last frame's camera and apply the brush where it hits.
+static void paintAtCursor(struct State *state, int mouseX, int mouseY)
+{
+    if (!state->have_camera)
+        return;
+
+    float ndcX = 2.0f * (mouseX + 0.5f) / state->viewport_w - 1.0f;
+    float ndcY = 1.0f - 2.0f * (mouseY + 0.5f) / state->viewport_h;
+    float nearPoint[4] = {ndcX, ndcY, -1.0f, 1.0f};
+    float farPoint[4] = {ndcX, ndcY, 1.0f, 1.0f};
+    mat4_mul_vec4(nearPoint, state->inv_view_proj, nearPoint);
+    mat4_mul_vec4(farPoint, state->inv_view_proj, farPoint);
+
+    float origin[3], dir[3];
+    for (int i = 0; i < 3; i++)
+    {
+        origin[i] = nearPoint[i] / nearPoint[3];
+        dir[i] = farPoint[i] / farPoint[3] - origin[i];
+    }
+
+    float hitX, hitZ;
+    if (raycastTerrain(state, origin, dir, &hitX, &hitZ))
+        applyBrush(state, hitX, hitZ);
+}
 
 void process_input(struct State *state)
 {
     SDL_Event event;
     const float zoomSpeed = 0.2f;
     const float orbitSpeed = 0.05f;
+    const float brushResize = 1.1f;
 
     while (SDL_PollEvent(&event))
     {
@@ -19,6 +48,36 @@ void process_input(struct State *state)
         {
             if (event.key.keysym.sym == SDLK_ESCAPE)
                 state->quit = true;
+            // Toggle droplet erosion with E
+            if (event.key.keysym.sym == SDLK_e)
+                setDropletErosion(&state->params, state->params.erode_rate == 0.0f);
+            // Toggle wind erosion with V
+            if (event.key.keysym.sym == SDLK_v)
+                state->params.wind_enabled = !state->params.wind_enabled;
+            // Toggle global rain with P (local rain bursts still work)
+            if (event.key.keysym.sym == SDLK_p)
+                setRain(state, !state->params.rain_enabled);
+            // Brush tools: 1 raise, 2 lower, 3 smooth, 4 rain burst
+            if (event.key.keysym.sym == SDLK_1)
+                state->brush.tool = BRUSH_RAISE;
+            if (event.key.keysym.sym == SDLK_2)
+                state->brush.tool = BRUSH_LOWER;
+            if (event.key.keysym.sym == SDLK_3)
+                state->brush.tool = BRUSH_SMOOTH;
+            if (event.key.keysym.sym == SDLK_4)
+                state->brush.tool = BRUSH_RAIN;
+        }
+        else if (event.type == SDL_MOUSEWHEEL)
+        {
+            // Resize the brush with the mouse wheel
+            if (event.wheel.y > 0)
+                state->brush.radius *= brushResize;
+            else if (event.wheel.y < 0)
+                state->brush.radius /= brushResize;
+            if (state->brush.radius < 0.02f)
+                state->brush.radius = 0.02f;
+            if (state->brush.radius > 1.0f)
+                state->brush.radius = 1.0f;
         }
     }
 
@@ -58,6 +117,12 @@ void process_input(struct State *state)
             state->height = 1.0f;
     }
 
+    // Paint with the left mouse button while held
+    int mouseX, mouseY;
+    Uint32 buttons = SDL_GetMouseState(&mouseX, &mouseY);
+    if (buttons & SDL_BUTTON(SDL_BUTTON_LEFT))
+        paintAtCursor(state, mouseX, mouseY);
+
     // Debug print
     printf("Camera dist: %.2f, orbit angle: %.2f\n", state->dist, state->orbit_angle);
 }
@@ -0,0 +1,379 @@
+#include "jobs.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define JOB_POOL_SIZE JOBS_MAX_JOBS // power of two: deques index with & (JOB_POOL_SIZE - 1)
+#define MAX_WORKERS 64
+#define MAX_DEPENDENTS 8
+
+// Shared bookkeeping of one jobs_parallel_for call.
+struct ForLoop
+{
+    ParallelForFn fn;
+    void *ctx;
+    int grain;
+    atomic_int remaining; // items not yet processed
+};
+
+struct Job
+{
+    JobFn fn;
+    void *ctx;
+
+    // Set instead of fn for a piece of a parallel_for.
+    struct ForLoop *loop;
+    int begin, end;
+
+    atomic_int pending; // unfinished dependencies (+1 while being submitted)
+    atomic_int refs;    // the system until the job finishes, plus the caller's handle
+    atomic_bool done;
+
+    pthread_mutex_t lock; // guards dependents and the transition to done
+    struct Job *dependents[MAX_DEPENDENTS];
+    int num_dependents;
+
+    struct Job *next_free;
+};
+
+struct Deque
+{
+    pthread_mutex_t lock;
+    struct Job *items[JOB_POOL_SIZE];
+    unsigned top;    // thieves take from here
+    unsigned bottom; // the owner pushes and pops here
+};
+
+static struct
+{
+    bool running;
+    int count;   // worker slots including the main thread
+    int started; // threads actually running (slots 1..started)
+    pthread_t threads[MAX_WORKERS];
+    struct Deque deques[MAX_WORKERS];
+
+    struct Job pool[JOB_POOL_SIZE];
+    struct Job *free_list;
+    pthread_mutex_t pool_lock;
+
+    // Idle workers sleep here until something is queued.
+    atomic_int queued;
+    atomic_bool quit;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;
+} js;
+
+static _Thread_local int tls_worker = 0;
+
+static struct Job *allocJob(void)
+{
+    pthread_mutex_lock(&js.pool_lock);
+    struct Job *job = js.free_list;
+    if (job)
+        js.free_list = job->next_free;
+    pthread_mutex_unlock(&js.pool_lock);
+    if (job == NULL)
+        return NULL;
+
+    job->fn = NULL;
+    job->ctx = NULL;
+    job->loop = NULL;
+    job->num_dependents = 0;
+    atomic_store(&job->pending, 0);
+    atomic_store(&job->refs, 1);
+    atomic_store(&job->done, false);
+    return job;
+}
+
+static void releaseJob(struct Job *job)
+{
+    if (atomic_fetch_sub(&job->refs, 1) != 1)
+        return;
+    pthread_mutex_lock(&js.pool_lock);
+    job->next_free = js.free_list;
+    js.free_list = job;
+    pthread_mutex_unlock(&js.pool_lock);
+}
+
+static void pushJob(struct Job *job)
+{
+    struct Deque *q = &js.deques[tls_worker];
+    pthread_mutex_lock(&q->lock);
+    q->items[q->bottom & (JOB_POOL_SIZE - 1)] = job;
+    q->bottom++;
+    pthread_mutex_unlock(&q->lock);
+
+    atomic_fetch_add(&js.queued, 1);
+    pthread_mutex_lock(&js.sleep_lock);
+    pthread_cond_signal(&js.wake);
+    pthread_mutex_unlock(&js.sleep_lock);
+}
+
+static struct Job *popJob(struct Deque *q)
+{
+    struct Job *job = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom != q->top)
+    {
+        q->bottom--;
+        job = q->items[q->bottom & (JOB_POOL_SIZE - 1)];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static struct Job *stealJob(struct Deque *q)
+{
+    struct Job *job = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom != q->top)
+    {
+        job = q->items[q->top & (JOB_POOL_SIZE - 1)];
+        q->top++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static void finishJob(struct Job *job)
+{
+    struct Job *ready[MAX_DEPENDENTS];
+    pthread_mutex_lock(&job->lock);
+    atomic_store(&job->done, true);
+    int n = job->num_dependents;
+    for (int i = 0; i < n; i++)
+        ready[i] = job->dependents[i];
+    pthread_mutex_unlock(&job->lock);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (atomic_fetch_sub(&ready[i]->pending, 1) == 1)
+            pushJob(ready[i]);
+    }
+    releaseJob(job);
+}
+
+// Run a parallel_for piece: split off upper halves for thieves, then run the rest.
+static void runRange(struct ForLoop *loop, int begin, int end)
+{
+    while (end - begin > loop->grain)
+    {
+        int mid = begin + (end - begin) / 2;
+        struct Job *half = allocJob();
+        if (half == NULL)
+            break; // pool exhausted: just do the whole range here
+        half->loop = loop;
+        half->begin = mid;
+        half->end = end;
+        pushJob(half);
+        end = mid;
+    }
+    loop->fn(loop->ctx, begin, end);
+    atomic_fetch_sub(&loop->remaining, end - begin);
+}
+
+static void executeJob(struct Job *job)
+{
+    if (job->loop)
+        runRange(job->loop, job->begin, job->end);
+    else
+        job->fn(job->ctx);
+    finishJob(job);
+}
+
+// Run one queued job, own deque first. Returns false if there was nothing to do.
+static bool runOneJob(void)
+{
+    int self = tls_worker;
+    struct Job *job = popJob(&js.deques[self]);
+    for (int k = 1; job == NULL && k < js.count; k++)
+        job = stealJob(&js.deques[(self + k) % js.count]);
+    if (job == NULL)
+        return false;
+
+    atomic_fetch_sub(&js.queued, 1);
+    executeJob(job);
+    return true;
+}
+
+static void *workerMain(void *arg)
+{
+    tls_worker = (int)(long)arg;
+    while (!atomic_load(&js.quit))
+    {
+        if (runOneJob())
+            continue;
+        pthread_mutex_lock(&js.sleep_lock);
+        while (atomic_load(&js.queued) == 0 && !atomic_load(&js.quit))
+            pthread_cond_wait(&js.wake, &js.sleep_lock);
+        pthread_mutex_unlock(&js.sleep_lock);
+    }
+    return NULL;
+}
+
+bool jobs_init(int num_workers)
+{
+    if (js.running)
+        return true;
+    if (num_workers < 0)
+        num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (num_workers < 0)
+        num_workers = 0;
+    if (num_workers > MAX_WORKERS - 1)
+        num_workers = MAX_WORKERS - 1;
+
+    pthread_mutex_init(&js.pool_lock, NULL);
+    pthread_mutex_init(&js.sleep_lock, NULL);
+    pthread_cond_init(&js.wake, NULL);
+    js.free_list = NULL;
+    for (int i = JOB_POOL_SIZE - 1; i >= 0; i--)
+    {
+        pthread_mutex_init(&js.pool[i].lock, NULL);
+        js.pool[i].next_free = js.free_list;
+        js.free_list = &js.pool[i];
+    }
+    for (int i = 0; i <= num_workers; i++)
+    {
+        pthread_mutex_init(&js.deques[i].lock, NULL);
+        js.deques[i].top = js.deques[i].bottom = 0;
+    }
+    atomic_store(&js.queued, 0);
+    atomic_store(&js.quit, false);
+
+    // Slots are fixed before any thread starts; a slot whose thread failed to
+    // start just has an empty deque that the others never find work in.
+    tls_worker = 0;
+    js.count = num_workers + 1;
+    js.started = 0;
+    js.running = true;
+    for (int i = 1; i <= num_workers; i++)
+    {
+        if (pthread_create(&js.threads[i], NULL, workerMain, (void *)(long)i) != 0)
+        {
+            printf("Failed to start job worker %d, continuing with %d.\n", i, js.started + 1);
+            break;
+        }
+        js.started++;
+    }
+    return true;
+}
+
+void jobs_shutdown(void)
+{
+    if (!js.running)
+        return;
+
+    // Drain whatever is still queued before stopping the workers.
+    while (runOneJob())
+        ;
+    atomic_store(&js.quit, true);
+    pthread_mutex_lock(&js.sleep_lock);
+    pthread_cond_broadcast(&js.wake);
+    pthread_mutex_unlock(&js.sleep_lock);
+    for (int i = 1; i <= js.started; i++)
+        pthread_join(js.threads[i], NULL);
+
+    for (int i = 0; i < js.count; i++)
+        pthread_mutex_destroy(&js.deques[i].lock);
+    for (int i = 0; i < JOB_POOL_SIZE; i++)
+        pthread_mutex_destroy(&js.pool[i].lock);
+    pthread_mutex_destroy(&js.pool_lock);
+    pthread_mutex_destroy(&js.sleep_lock);
+    pthread_cond_destroy(&js.wake);
+    js.running = false;
+    js.count = 0;
+}
+
+int jobs_worker_count(void)
+{
+    return js.running ? js.started + 1 : 1;
+}
+
+// Help out until job is done, without releasing the handle.
+static void helpUntilDone(struct Job *job)
+{
+    while (!atomic_load(&job->done))
+    {
+        if (!runOneJob())
+            sched_yield();
+    }
+}
+
+struct Job *jobs_submit(JobFn fn, void *ctx, struct Job *const *deps, int num_deps)
+{
+    if (!js.running)
+    {
+        fn(ctx);
+        return NULL;
+    }
+
+    struct Job *job;
+    while ((job = allocJob()) == NULL)
+    {
+        if (!runOneJob())
+            sched_yield();
+    }
+    job->fn = fn;
+    job->ctx = ctx;
+    atomic_store(&job->refs, 2);
+    atomic_store(&job->pending, 1);
+
+    for (int i = 0; i < num_deps; i++)
+    {
+        struct Job *dep = deps[i];
+        if (dep == NULL)
+            continue;
+        pthread_mutex_lock(&dep->lock);
+        bool registered = false;
+        if (!atomic_load(&dep->done) && dep->num_dependents < MAX_DEPENDENTS)
+        {
+            dep->dependents[dep->num_dependents++] = job;
+            atomic_fetch_add(&job->pending, 1);
+            registered = true;
+        }
+        pthread_mutex_unlock(&dep->lock);
+        // Too many dependents on dep: satisfy the edge by waiting here instead.
+        if (!registered)
+            helpUntilDone(dep);
+    }
+
+    if (atomic_fetch_sub(&job->pending, 1) == 1)
+        pushJob(job);
+    return job;
+}
+
+void jobs_wait(struct Job *job)
+{
+    if (job == NULL)
+        return;
+    helpUntilDone(job);
+    releaseJob(job);
+}
+
+void jobs_parallel_for(int begin, int end, int grain, ParallelForFn fn, void *ctx)
+{
+    if (end <= begin)
+        return;
+    if (grain < 1)
+        grain = 1;
+    if (!js.running || js.started == 0 || end - begin <= grain)
+    {
+        fn(ctx, begin, end);
+        return;
+    }
+
+    struct ForLoop loop;
+    loop.fn = fn;
+    loop.ctx = ctx;
+    loop.grain = grain;
+    atomic_store(&loop.remaining, end - begin);
+
+    runRange(&loop, begin, end);
+    while (atomic_load(&loop.remaining) > 0)
+    {
+        if (!runOneJob())
+            sched_yield();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+// One work-stealing job system shared by simulation, meshing and I/O, so the
+// modules never spin up competing threads. Each worker owns a deque: it pushes
+// and pops at the bottom, idle workers steal from the top of the others.
+// The thread that called jobs_init counts as worker 0 and runs jobs whenever
+// it waits. Before jobs_init (or after jobs_shutdown) everything runs inline.
+
+// At most JOBS_MAX_JOBS jobs exist at once, counting handles not yet passed to
+// jobs_wait. While the pool is empty, jobs_submit runs queued jobs until one is
+// released and jobs_parallel_for runs its pieces inline, so a caller must never
+// hold JOBS_MAX_JOBS handles and then submit another job.
+#define JOBS_MAX_JOBS 4096
+
+typedef void (*JobFn)(void *ctx);
+typedef void (*ParallelForFn)(void *ctx, int begin, int end);
+
+struct Job; // opaque handle, valid until passed to jobs_wait
+
+// Start num_workers threads in addition to the caller; negative = one per extra core.
+bool jobs_init(int num_workers);
+void jobs_shutdown(void);
+
+// Threads that execute jobs, including the caller of jobs_init.
+int jobs_worker_count(void);
+
+// Queue fn(ctx) to run once every job in deps has finished. NULL deps are ignored.
+// A dep with too many dependents already is waited for here instead.
+// Returns NULL if the job already ran inline (no job system).
+struct Job *jobs_submit(JobFn fn, void *ctx, struct Job *const *deps, int num_deps);
+
+// Run other jobs until job has finished, then release the handle. NULL is a no-op.
+void jobs_wait(struct Job *job);
+
+// Call fn on disjoint subranges of [begin, end) no smaller than grain (except the
+// last) and return when all are done. fn must only write data owned by its range,
+// so the result doesn't depend on how the range was split or which thread ran it.
+void jobs_parallel_for(int begin, int end, int grain, ParallelForFn fn, void *ctx);
+
+#endif // JOBS_H
@@ -3,13 +3,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <time.h>
 
 #include "state.h"
 #include "shader_utils.h"
+#include "droplet_renderer.h"
 #include "input.h"
 #include "matrix.h"
 #include "gen.h"
-#include "util.h" // for rand_range()
+#include "jobs.h"
 
 #define WIDTH 800
 #define HEIGHT 600
@@ -18,17 +21,121 @@
 #define M_PI 3.14159265358979323846
 #endif
 
-// Helper to set override color in the shader.
-void setOverrideColor(GLuint shader, bool useOverride, float r, float g, float b, float a)
+static void printUsage(const char *program)
 {
-    GLint locOverride = glGetUniformLocation(shader, "useOverrideColor");
-    GLint locColor = glGetUniformLocation(shader, "overrideColor");
-    glUniform1i(locOverride, useOverride ? 1 : 0);
-    glUniform4f(locColor, r, g, b, a);
+    printf("Usage: %s [--seed N] [--threads N]\n", program);
+}
+
+// Each frame the next step runs as a job while the render thread meshes the
+// previous step's snapshot. Only dirty mesh tiles are snapshotted, meshed and
+// uploaded, grouped into regions.
+struct MeshRegion
+{
+    float *vertices;
+    float *heights; // snapshot of vertices (i0..i1+1, j0..j1+1), stride j1 - j0 + 2
+    int i0, i1, j0, j1;
+};
+
+struct MeshUpdate
+{
+    struct MeshRegion regions[MESH_TILES * MESH_TILES];
+    int count;
+};
+
+static void meshRegions(struct MeshUpdate *mesh)
+{
+    for (int r = 0; r < mesh->count; r++)
+    {
+        struct MeshRegion *region = &mesh->regions[r];
+        generateMeshRegion(region->vertices, region->heights, region->j1 - region->j0 + 2,
+                           region->i0, region->i1, region->j0, region->j1);
+    }
+}
+
+// Group dirty tiles into regions: runs of neighbouring tiles in a tile row, with
+// consecutive full-width rows merged so they upload as one contiguous range.
+static int collectMeshRegions(uint64_t tiles, struct MeshRegion *regions)
+{
+    int count = 0;
+    for (int ti = 0; ti < MESH_TILES; ti++)
+    {
+        for (int tj = 0; tj < MESH_TILES; tj++)
+        {
+            if (!(tiles & meshTileBit(ti, tj)))
+                continue;
+            int start = tj;
+            while (tj + 1 < MESH_TILES && (tiles & meshTileBit(ti, tj + 1)))
+                tj++;
+
+            struct MeshRegion region = {0};
+            region.i0 = ti * MESH_TILE;
+            region.i1 = region.i0 + MESH_TILE - 1 < GRID_SIZE - 2 ? region.i0 + MESH_TILE - 1 : GRID_SIZE - 2;
+            region.j0 = start * MESH_TILE;
+            region.j1 = tj * MESH_TILE + MESH_TILE - 1 < GRID_SIZE - 2 ? tj * MESH_TILE + MESH_TILE - 1 : GRID_SIZE - 2;
+
+            struct MeshRegion *last = count > 0 ? &regions[count - 1] : NULL;
+            bool fullWidth = region.j0 == 0 && region.j1 == GRID_SIZE - 2;
+            if (fullWidth && last && last->j0 == 0 && last->j1 == GRID_SIZE - 2 && last->i1 + 1 == region.i0)
+                last->i1 = region.i1;
+            else
+                regions[count++] = region;
+        }
+    }
+    return count;
+}
+
+// Upload the packed vertices of cells [i0,i1] x [j0,j1] into the full-grid terrain VBO.
+static void uploadMeshRegion(GLuint vbo, const struct MeshRegion *job)
+{
+    const int floatsPerCell = 18;
+    int cols = job->j1 - job->j0 + 1;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (cols == GRID_SIZE - 1)
+    {
+        // Full-width rows are contiguous in the VBO.
+        GLintptr offset = sizeof(float) * (GLintptr)job->i0 * cols * floatsPerCell;
+        GLsizeiptr size = sizeof(float) * (GLsizeiptr)(job->i1 - job->i0 + 1) * cols * floatsPerCell;
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, job->vertices);
+        return;
+    }
+    for (int i = job->i0; i <= job->i1; i++)
+    {
+        GLintptr offset = sizeof(float) * ((GLintptr)i * (GRID_SIZE - 1) + job->j0) * floatsPerCell;
+        const float *src = job->vertices + (size_t)(i - job->i0) * cols * floatsPerCell;
+        glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(float) * cols * floatsPerCell, src);
+    }
+}
+
+static void simulateJob(void *ctx)
+{
+    stepSimulation(ctx);
 }
 
 int main(int argc, char *argv[])
 {
+    // Command line: a fixed seed makes the interactive run reproducible.
+    bool haveSeed = false;
+    uint32_t seed = 0;
+    int threads = -1; // one worker per extra core
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+            haveSeed = true;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    jobs_init(threads);
     SDL_Init(SDL_INIT_VIDEO);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
@@ -45,8 +152,8 @@ int main(int argc, char *argv[])
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glEnable(GL_DEPTH_TEST);
 
-    GLuint shader_program = createShaderProgram();
-    if (shader_program == 0)
+    struct ShaderProgram terrainShader;
+    if (!shaderProgramLoad(&terrainShader, "vertex_shader.glsl", "fragment_shader.glsl"))
     {
         SDL_GL_DeleteContext(gl_context);
         SDL_DestroyWindow(window);
@@ -55,11 +162,25 @@ int main(int argc, char *argv[])
     }
 
     struct State state;
+    memset(&state, 0, sizeof(state));
     state.quit = false;
+    state.viewport_w = WIDTH;
+    state.viewport_h = HEIGHT;
+    initBrush(&state.brush);
+    if (!initArenas(&state))
+        return 1;
     initializeGrid(&state);
 
-    // 1) Initialize droplet
-    initDroplet(&state.droplet);
+    // 1) Initialize droplets
+    state.droplet_count = DROPLET_COUNT;
+    state.droplets = malloc(sizeof(struct Droplet) * state.droplet_count);
+    if (!state.droplets)
+    {
+        printf("Failed to allocate droplet memory.\n");
+        return 1;
+    }
+    initErosionParams(&state.params);
+    seedDroplets(&state, haveSeed ? seed : (uint32_t)time(NULL));
 
     // 2) Set camera orbit parameters
     state.orbit_angle = 0.0f;
@@ -69,12 +190,9 @@ int main(int argc, char *argv[])
     // 3) Prepare terrain VBO/VAO
     int numCells = (GRID_SIZE - 1) * (GRID_SIZE - 1);
     int vertexCount = numCells * 6;
-    float *vertices = malloc(sizeof(float) * vertexCount * 3);
+    float *vertices = arena_alloc(&state.frame_arena, sizeof(float) * MESH_FLOAT_COUNT, 64);
     if (!vertices)
-    {
-        printf("Failed to allocate vertex memory.\n");
         return 1;
-    }
     generateMesh(vertices, &state);
 
     GLuint terrainVBO, terrainVAO;
@@ -82,31 +200,17 @@ int main(int argc, char *argv[])
     glGenBuffers(1, &terrainVBO);
     glBindVertexArray(terrainVAO);
     glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertexCount * 3, vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    free(vertices);
-
-    // 4) Prepare droplet VAO/VBO (for the point)
-    GLuint dropletVAO, dropletVBO;
-    glGenVertexArrays(1, &dropletVAO);
-    glBindVertexArray(dropletVAO);
-    glGenBuffers(1, &dropletVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, dropletVBO);
-    float dropletVertex[3] = {0.0f, 0.0f, 0.0f};
-    glBufferData(GL_ARRAY_BUFFER, sizeof(dropletVertex), dropletVertex, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * MESH_FLOAT_COUNT, vertices, GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(0);
 
-    // 5) Prepare trail VAO/VBO
-    GLuint trailVAO, trailVBO;
-    glGenVertexArrays(1, &trailVAO);
-    glBindVertexArray(trailVAO);
-    glGenBuffers(1, &trailVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * TRAIL_LENGTH, NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
+    // 4) Prepare batched droplet/trail renderer
+    struct DropletRenderer dropletRenderer;
+    if (!dropletRendererInit(&dropletRenderer, state.droplet_count))
+    {
+        printf("Failed to create droplet renderer.\n");
+        return 1;
+    }
 
     // 6) Projection and model matrices.
     float proj[16];
@@ -114,43 +218,55 @@ int main(int argc, char *argv[])
     float model[16];
     mat4_identity(model);
 
-    // Set static uniforms.
-    glUseProgram(shader_program);
-    // Pass the model matrix.
-    GLint modelLoc = glGetUniformLocation(shader_program, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, model);
-
-    // Set directional light: light coming from above and to the right.
+    // Directional light: light coming from above and to the right.
     float lightDir[3] = {0.5f, 1.0f, -0.5f};
     float mag = sqrtf(lightDir[0] * lightDir[0] + lightDir[1] * lightDir[1] + lightDir[2] * lightDir[2]);
     lightDir[0] /= mag;
     lightDir[1] /= mag;
     lightDir[2] /= mag;
-    GLint lightDirLoc = glGetUniformLocation(shader_program, "lightDir");
-    glUniform3fv(lightDirLoc, 1, lightDir);
-
-    // Set light color (white).
-    GLint lightColorLoc = glGetUniformLocation(shader_program, "lightColor");
-    glUniform3f(lightColorLoc, 1.0f, 1.0f, 1.0f);
+    int terrainGeneration = 0; // generation of terrainShader whose static uniforms are set
 
     // Render loop.
     while (!state.quit)
     {
+        arena_reset(&state.frame_arena);
         process_input(&state);
 
-        if (!state.droplet.active)
+        // Pick up shader edits without restarting the simulation.
+        shaderProgramReloadIfChanged(&terrainShader);
+        shaderProgramReloadIfChanged(&dropletRenderer.program);
+
+        // Snapshot the tiles changed since the last mesh update (previous step
+        // plus this frame's edits), then mesh them while the next step runs.
+        // Snapshots and vertices come from frame scratch.
+        uint64_t dirtyTiles = takeDirty(&state);
+        struct MeshUpdate mesh;
+        mesh.count = collectMeshRegions(dirtyTiles, mesh.regions);
+        for (int r = 0; r < mesh.count; r++)
         {
-            initDroplet(&state.droplet);
+            struct MeshRegion *region = &mesh.regions[r];
+            int rows = region->i1 - region->i0 + 2, cols = region->j1 - region->j0 + 2;
+            region->heights = arena_alloc(&state.frame_arena, sizeof(float) * rows * cols, 64);
+            region->vertices = arena_alloc(&state.frame_arena, sizeof(float) * (rows - 1) * (cols - 1) * 18, 64);
+            if (!region->heights || !region->vertices)
+            {
+                // Out of scratch: keep the tiles pending for next frame.
+                state.dirty_tiles |= dirtyTiles;
+                mesh.count = 0;
+                break;
+            }
+            for (int k = 0; k < rows; k++)
+                memcpy(&region->heights[k * cols], &state.grid[region->i0 + k][region->j0], sizeof(float) * cols);
         }
-
-        updateDroplet(&state.droplet, &state);
-
-        // Re-generate terrain mesh each frame.
-        float *dynamicVerts = malloc(sizeof(float) * vertexCount * 3);
-        generateMesh(dynamicVerts, &state);
-        glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertexCount * 3, dynamicVerts, GL_STATIC_DRAW);
-        free(dynamicVerts);
+        // Submit the step first: a worker steals it from the top of this
+        // thread's deque, while the mesh pieces this thread pushes afterwards
+        // sit at the bottom, where it pops them itself. Meshing and the upload
+        // happen here on the GL thread, so the step keeps running meanwhile.
+        struct Job *simulating = jobs_submit(simulateJob, &state, NULL, 0);
+        meshRegions(&mesh);
+        for (int r = 0; r < mesh.count; r++)
+            uploadMeshRegion(terrainVBO, &mesh.regions[r]);
+        jobs_wait(simulating);
 
         // Camera setup.
         float eye[3];
@@ -165,46 +281,43 @@ int main(int argc, char *argv[])
         mat4_mul(pv, proj, view);
         float mvp[16];
         mat4_mul(mvp, pv, model);
+        // Kept for next frame's mouse picking.
+        state.have_camera = mat4_invert(state.inv_view_proj, mvp);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(shader_program);
-        GLint mvp_location = glGetUniformLocation(shader_program, "mvp");
-        glUniformMatrix4fv(mvp_location, 1, GL_FALSE, mvp);
+        const GLint *uniforms = terrainShader.uniforms;
+        glUseProgram(terrainShader.id);
+        if (terrainGeneration != terrainShader.generation)
+        {
+            // Static uniforms, set after every (re)link. Only terrain uses this
+            // program, so the override color stays off.
+            glUniformMatrix4fv(uniforms[UNIFORM_MODEL], 1, GL_FALSE, model);
+            glUniform3fv(uniforms[UNIFORM_LIGHT_DIR], 1, lightDir);
+            glUniform3f(uniforms[UNIFORM_LIGHT_COLOR], 1.0f, 1.0f, 1.0f);
+            glUniform1i(uniforms[UNIFORM_USE_OVERRIDE_COLOR], 0);
+            terrainGeneration = terrainShader.generation;
+        }
+        glUniformMatrix4fv(uniforms[UNIFORM_MVP], 1, GL_FALSE, mvp);
 
         // Draw terrain.
-        setOverrideColor(shader_program, false, 0.0f, 0.0f, 0.0f, 1.0f);
         glBindVertexArray(terrainVAO);
         glDrawArrays(GL_TRIANGLES, 0, vertexCount);
 
-        // Draw droplet point.
-        float dropletPos[3] = {state.droplet.x, state.droplet.y, state.droplet.z};
-        glBindVertexArray(dropletVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, dropletVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(dropletPos), dropletPos);
-        setOverrideColor(shader_program, true, 0.0f, 0.0f, 0.0f, 1.0f);
-        glPointSize(10.0f);
-        glDrawArrays(GL_POINTS, 0, 1);
-        setOverrideColor(shader_program, false, 0.0f, 0.0f, 0.0f, 1.0f);
-
-        // Draw droplet trail.
-        glBindVertexArray(trailVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * state.droplet.trail_count, state.droplet.trail);
-        setOverrideColor(shader_program, true, 0.0f, 0.0f, 0.0f, 1.0f);
-        glLineWidth(2.0f);
-        glDrawArrays(GL_LINE_STRIP, 0, state.droplet.trail_count);
-        setOverrideColor(shader_program, false, 0.0f, 0.0f, 0.0f, 1.0f);
+        // Draw all droplets and their trails.
+        dropletRendererDraw(&dropletRenderer, state.droplets, state.droplet_count, mvp);
 
         SDL_GL_SwapWindow(window);
     }
 
     glDeleteVertexArrays(1, &terrainVAO);
     glDeleteBuffers(1, &terrainVBO);
-    glDeleteVertexArrays(1, &dropletVAO);
-    glDeleteBuffers(1, &dropletVBO);
-    glDeleteVertexArrays(1, &trailVAO);
-    glDeleteBuffers(1, &trailVBO);
-    glDeleteProgram(shader_program);
+    dropletRendererDestroy(&dropletRenderer);
+    free(state.droplets);
+    arena_report(&state.frame_arena);
+    arena_report(&state.sim_arena);
+    destroyArenas(&state);
+    jobs_shutdown();
+    shaderProgramDestroy(&terrainShader);
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,281 @@
+#include "replay.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gen.h"
+#include "jobs.h"
+
+// Droplet erosion is off by default; every scenario checks it.
+static void configureErosion(struct ErosionParams *params)
+{
+    setDropletErosion(params, true);
+}
+
+// Exercise the other kernel variants: bilinear sampling, inertia, no trails, wide brush.
+static void configureBilinearInertia(struct ErosionParams *params)
+{
+    setDropletErosion(params, true);
+    params->bilinear = true;
+    params->inertia = 0.3f;
+    params->record_trail = false;
+    params->brush_radius = 3;
+}
+
+static void configureWind(struct ErosionParams *params)
+{
+    setDropletErosion(params, true);
+    params->wind_enabled = true;
+    params->wind_x = -0.8f;
+    params->wind_z = 0.6f;
+}
+
+// Rain off: finished droplets retire instead of respawning.
+static void configureNoRain(struct ErosionParams *params)
+{
+    setDropletErosion(params, true);
+    params->rain_enabled = false;
+}
+
+static const struct Scenario scenarios[] = {
+    {"single_droplet", 1u, 1, 2000, 0.0f, configureErosion},
+    {"default_population", 12345u, DROPLET_COUNT, 600, 1e-5f, configureErosion},
+    {"dense_short", 7u, 8192, 120, 1e-5f, configureErosion},
+    {"bilinear_inertia", 99u, DROPLET_COUNT, 600, 1e-5f, configureBilinearInertia},
+    {"wind", 2024u, DROPLET_COUNT, 600, 1e-5f, configureWind},
+    {"no_rain", 31u, DROPLET_COUNT, 600, 1e-5f, configureNoRain},
+};
+
+#define DROPLET_SNAPSHOT_FLOATS 7
+
+// Pack the compared droplet fields, in the order used by the snapshot format.
+static void packDroplet(const struct Droplet *d, float out[DROPLET_SNAPSHOT_FLOATS])
+{
+    out[0] = d->x;
+    out[1] = d->y;
+    out[2] = d->z;
+    out[3] = d->sediment;
+    out[4] = d->water;
+    out[5] = d->speed;
+    out[6] = d->active ? 1.0f : 0.0f;
+}
+
+// Bitwise comparison of the snapshot fields of two droplet arrays (struct padding is ignored).
+static bool sameDroplets(const struct Droplet *a, const struct Droplet *b, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float pa[DROPLET_SNAPSHOT_FLOATS], pb[DROPLET_SNAPSHOT_FLOATS];
+        packDroplet(&a[i], pa);
+        packDroplet(&b[i], pb);
+        if (memcmp(pa, pb, sizeof(pa)) != 0)
+            return false;
+    }
+    return true;
+}
+
+int runScenario(struct State *state, const struct Scenario *scenario)
+{
+    state->droplet_count = scenario->droplets;
+    initErosionParams(&state->params);
+    if (scenario->configure)
+        scenario->configure(&state->params);
+    initializeGrid(state);
+    seedDroplets(state, scenario->seed);
+
+    float initial[GRID_SIZE][GRID_SIZE];
+    memcpy(initial, state->grid, sizeof(initial));
+    for (int step = 0; step < scenario->steps; step++)
+        stepSimulation(state);
+
+    int changed = 0;
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+            changed += state->grid[i][j] != initial[i][j];
+    }
+    return changed;
+}
+
+bool saveHeightmap(const char *path, const struct State *state)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Failed to open file for writing: %s\n", path);
+        return false;
+    }
+    uint32_t size = GRID_SIZE;
+    uint32_t count = (uint32_t)state->droplet_count;
+    bool ok = fwrite("HMAP", 1, 4, file) == 4 &&
+              fwrite(&size, sizeof(size), 1, file) == 1 &&
+              fwrite(state->grid, sizeof(state->grid), 1, file) == 1 &&
+              fwrite(&count, sizeof(count), 1, file) == 1;
+    for (int i = 0; ok && i < state->droplet_count; i++)
+    {
+        float packed[DROPLET_SNAPSHOT_FLOATS];
+        packDroplet(&state->droplets[i], packed);
+        ok = fwrite(packed, sizeof(packed), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+        printf("Failed to write heightmap: %s\n", path);
+    return ok;
+}
+
+// Track the largest absolute difference seen so far.
+static void accumulateError(float *worst, float value, float golden)
+{
+    float diff = fabsf(value - golden);
+    if (!(diff <= *worst)) // also catches NaN
+        *worst = diff;
+}
+
+bool compareHeightmap(const char *path, const struct State *state, float tolerance, float *maxError)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Failed to open golden file: %s\n", path);
+        return false;
+    }
+
+    char magic[4];
+    uint32_t size = 0;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "HMAP", 4) != 0 ||
+        fread(&size, sizeof(size), 1, file) != 1 || size != GRID_SIZE)
+    {
+        printf("Golden file %s is not a %dx%d heightmap.\n", path, GRID_SIZE, GRID_SIZE);
+        fclose(file);
+        return false;
+    }
+
+    float *golden = malloc(sizeof(state->grid));
+    if (golden == NULL || fread(golden, sizeof(state->grid), 1, file) != 1)
+    {
+        printf("Failed to read golden file: %s\n", path);
+        free(golden);
+        fclose(file);
+        return false;
+    }
+
+    float worst = 0.0f;
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+            accumulateError(&worst, state->grid[i][j], golden[i * GRID_SIZE + j]);
+    }
+    free(golden);
+
+    uint32_t count = 0;
+    if (fread(&count, sizeof(count), 1, file) != 1 || count != (uint32_t)state->droplet_count)
+    {
+        printf("Golden file %s does not hold %d droplets.\n", path, state->droplet_count);
+        fclose(file);
+        return false;
+    }
+    bool ok = true;
+    for (int i = 0; i < state->droplet_count; i++)
+    {
+        float expected[DROPLET_SNAPSHOT_FLOATS], actual[DROPLET_SNAPSHOT_FLOATS];
+        if (fread(expected, sizeof(expected), 1, file) != 1)
+        {
+            printf("Failed to read golden file: %s\n", path);
+            ok = false;
+            break;
+        }
+        packDroplet(&state->droplets[i], actual);
+        for (int k = 0; k < DROPLET_SNAPSHOT_FLOATS; k++)
+            accumulateError(&worst, actual[k], expected[k]);
+    }
+    fclose(file);
+
+    if (maxError)
+        *maxError = worst;
+    return ok && worst <= tolerance;
+}
+
+int runReplay(const char *dir, bool record, int threads)
+{
+    int numScenarios = (int)(sizeof(scenarios) / sizeof(scenarios[0]));
+    int maxDroplets = 0;
+    for (int i = 0; i < numScenarios; i++)
+    {
+        if (scenarios[i].droplets > maxDroplets)
+            maxDroplets = scenarios[i].droplets;
+    }
+
+    struct State *state = calloc(1, sizeof(struct State));
+    struct Droplet *serialDroplets = malloc(sizeof(struct Droplet) * maxDroplets);
+    if (state)
+        state->droplets = malloc(sizeof(struct Droplet) * maxDroplets);
+    if (!state || !state->droplets || !serialDroplets || !initArenas(state))
+    {
+        printf("Failed to allocate replay state.\n");
+        if (state)
+            free(state->droplets);
+        free(state);
+        free(serialDroplets);
+        return numScenarios;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < numScenarios; i++)
+    {
+        const struct Scenario *scenario = &scenarios[i];
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.hmap", dir, scenario->name);
+
+        // Serial reference run, without the job system.
+        // A scenario that leaves the terrain untouched would pass against any golden.
+        if (runScenario(state, scenario) == 0)
+        {
+            printf("[FAIL] %s: no cell changed height\n", scenario->name);
+            failures++;
+            continue;
+        }
+
+        // Run again on the worker pool: parallel passes must not change a single bit.
+        float serial[GRID_SIZE][GRID_SIZE];
+        memcpy(serial, state->grid, sizeof(serial));
+        memcpy(serialDroplets, state->droplets, sizeof(struct Droplet) * scenario->droplets);
+        jobs_init(threads);
+        int workers = jobs_worker_count();
+        runScenario(state, scenario);
+        jobs_shutdown();
+        if (memcmp(serial, state->grid, sizeof(serial)) != 0 ||
+            !sameDroplets(serialDroplets, state->droplets, scenario->droplets))
+        {
+            printf("[FAIL] %s: the %d-thread run differs from the serial run\n", scenario->name, workers);
+            failures++;
+            continue;
+        }
+
+        if (record)
+        {
+            if (saveHeightmap(path, state))
+                printf("[REC ] %s -> %s\n", scenario->name, path);
+            else
+                failures++;
+            continue;
+        }
+
+        float maxError = 0.0f;
+        if (compareHeightmap(path, state, scenario->tolerance, &maxError))
+        {
+            printf("[ OK ] %s (max error %g, serial and %d-thread runs identical)\n", scenario->name, maxError, workers);
+        }
+        else
+        {
+            printf("[FAIL] %s (max error %g, tolerance %g)\n", scenario->name, maxError, scenario->tolerance);
+            failures++;
+        }
+    }
+
+    arena_report(&state->sim_arena);
+    destroyArenas(state);
+    free(state->droplets);
+    free(state);
+    free(serialDroplets);
+    return failures;
+}
@@ -0,0 +1,36 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "state.h"
+
+// A seeded, headless simulation run whose final heightmap and droplet state are
+// compared against a golden snapshot.
+struct Scenario
+{
+    const char *name;  // also the golden file name (<dir>/<name>.hmap)
+    uint32_t seed;
+    int droplets;
+    int steps;
+    float tolerance;   // max allowed absolute difference per height or droplet value
+    void (*configure)(struct ErosionParams *params); // optional tweaks on top of the defaults
+};
+
+// Reset state to the initial terrain and run the scenario.
+// state->droplets must hold at least scenario->droplets entries.
+// Returns the number of cells whose height changed.
+int runScenario(struct State *state, const struct Scenario *scenario);
+
+// Snapshot I/O. Format: "HMAP", uint32 grid size, GRID_SIZE*GRID_SIZE floats,
+// uint32 droplet count, then per droplet x, y, z, sediment, water, speed, active (7 floats).
+bool saveHeightmap(const char *path, const struct State *state);
+bool compareHeightmap(const char *path, const struct State *state, float tolerance, float *maxError);
+
+// Run every built-in scenario serially and again with threads job workers
+// (negative = one per extra core); the two runs must be bit-identical. With
+// record set, (re)write the goldens in dir; otherwise compare against them.
+// Starts and stops the job system itself. Returns the number of failing scenarios.
+int runReplay(const char *dir, bool record, int threads);
+
+#endif // REPLAY_H
@@ -1,6 +1,30 @@
 #include "shader_utils.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define PROGRAM_BINARY_MAGIC 0x4e494250u     // "PBIN"
+#define PROGRAM_BINARY_MAX_SIZE (16u << 20) // reject corrupt cache files
+
+static const char *uniformNames[UNIFORM_COUNT] = {
+    [UNIFORM_MVP] = "mvp",
+    [UNIFORM_MODEL] = "model",
+    [UNIFORM_USE_OVERRIDE_COLOR] = "useOverrideColor",
+    [UNIFORM_OVERRIDE_COLOR] = "overrideColor",
+    [UNIFORM_LIGHT_DIR] = "lightDir",
+    [UNIFORM_LIGHT_COLOR] = "lightColor",
+};
+
+// Header of a cached program binary. key identifies the sources and driver it was built from.
+struct ProgramBinaryHeader
+{
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint32_t length;
+};
 
 char *readFile(const char *filename)
 {
@@ -23,21 +47,15 @@ char *readFile(const char *filename)
         return NULL;
     }
 
-    fread(buffer, 1, length, file);
-    buffer[length] = '\0';
+    size_t read = fread(buffer, 1, length, file);
+    buffer[read] = '\0';
 
     fclose(file);
     return buffer;
 }
 
-GLuint createShader(GLenum type, const char *filename)
+static GLuint compileShaderSource(GLenum type, const char *source)
 {
-    char *source = readFile(filename);
-    if (source == NULL)
-    {
-        return 0;
-    }
-
     GLuint shader = glCreateShader(type);
     glShaderSource(shader, 1, (const GLchar **)&source, NULL);
     glCompileShader(shader);
@@ -50,32 +68,29 @@ GLuint createShader(GLenum type, const char *filename)
         glGetShaderInfoLog(shader, 512, NULL, infoLog);
         printf("Shader compilation failed:\n%s\n", infoLog);
         glDeleteShader(shader);
-        free(source);
         return 0;
     }
-
-    free(source);
     return shader;
 }
 
-GLuint createShaderProgram()
+// Compile and link two sources. With retrievable set, the driver is asked to
+// keep the linked binary so it can be cached.
+static GLuint linkProgramSources(const char *vertex_source, const char *fragment_source, bool retrievable)
 {
-    char *shader_dir = "src/shaders/";
-    char *vertex_shader_path = "vertex_shader.glsl";
-    char *fragment_shader_path = "fragment_shader.glsl";
-    char vertex_shader_full_path[256];
-    char fragment_shader_full_path[256];
-    sprintf(vertex_shader_full_path, "%s%s", shader_dir, vertex_shader_path);
-    sprintf(fragment_shader_full_path, "%s%s", shader_dir, fragment_shader_path);
-
-    GLuint vertexShader = createShader(GL_VERTEX_SHADER, vertex_shader_full_path);
-    GLuint fragmentShader = createShader(GL_FRAGMENT_SHADER, fragment_shader_full_path);
+    GLuint vertexShader = compileShaderSource(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragmentShader = compileShaderSource(GL_FRAGMENT_SHADER, fragment_source);
     if (vertexShader == 0 || fragmentShader == 0)
     {
+        if (vertexShader != 0)
+            glDeleteShader(vertexShader);
+        if (fragmentShader != 0)
+            glDeleteShader(fragmentShader);
         return 0;
     }
 
     GLuint shaderProgram = glCreateProgram();
+    if (retrievable)
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
     glLinkProgram(shaderProgram);
@@ -93,7 +108,260 @@ GLuint createShaderProgram()
         return 0;
     }
 
+    glDetachShader(shaderProgram, vertexShader);
+    glDetachShader(shaderProgram, fragmentShader);
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
     return shaderProgram;
 }
+
+// Program binaries need GL 4.1 or GL_ARB_get_program_binary, and a driver that
+// exposes at least one binary format.
+static bool programBinarySupported(void)
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        GLint formats = 0;
+        if (SDL_GL_ExtensionSupported("GL_ARB_get_program_binary"))
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+    }
+    return supported;
+}
+
+// FNV-1a, chained over each string including its terminator.
+static uint64_t hashString(uint64_t hash, const char *s)
+{
+    if (s == NULL)
+        s = "";
+    do
+    {
+        hash ^= (unsigned char)*s;
+        hash *= 1099511628211ull;
+    } while (*s++);
+    return hash;
+}
+
+static uint64_t sourceHash(const char *vertex_source, const char *fragment_source)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashString(hash, vertex_source);
+    return hashString(hash, fragment_source);
+}
+
+// Binaries are only valid for the exact sources and driver that produced them.
+static uint64_t programBinaryKey(uint64_t source_hash)
+{
+    uint64_t key = source_hash;
+    key = hashString(key, (const char *)glGetString(GL_VENDOR));
+    key = hashString(key, (const char *)glGetString(GL_RENDERER));
+    key = hashString(key, (const char *)glGetString(GL_VERSION));
+    return key;
+}
+
+// Returns the cached program for key, or 0 if there is none or the driver rejects it.
+static GLuint loadProgramBinary(const char *path, uint64_t key)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+
+    struct ProgramBinaryHeader header;
+    void *binary = NULL;
+    GLuint shaderProgram = 0;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_BINARY_MAGIC &&
+        header.key == key && header.length > 0 && header.length <= PROGRAM_BINARY_MAX_SIZE)
+    {
+        binary = malloc(header.length);
+        if (binary && fread(binary, 1, header.length, file) == header.length)
+        {
+            shaderProgram = glCreateProgram();
+            glProgramBinary(shaderProgram, header.format, binary, (GLsizei)header.length);
+            GLint success;
+            glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                // Usually a driver update; the caller relinks and overwrites the entry.
+                glDeleteProgram(shaderProgram);
+                shaderProgram = 0;
+            }
+        }
+    }
+    free(binary);
+    fclose(file);
+    return shaderProgram;
+}
+
+static void saveProgramBinary(const char *path, uint64_t key, GLuint shaderProgram)
+{
+    GLint length = 0;
+    glGetProgramiv(shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || (GLuint)length > PROGRAM_BINARY_MAX_SIZE)
+        return;
+    void *binary = malloc(length);
+    if (binary == NULL)
+        return;
+
+    struct ProgramBinaryHeader header = {0};
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(shaderProgram, length, &written, &format, binary);
+    header.magic = PROGRAM_BINARY_MAGIC;
+    header.format = format;
+    header.key = key;
+    header.length = (uint32_t)written;
+
+    // Write to a temporary name and rename, so a crash never leaves a torn entry.
+    char tmpPath[272];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    mkdir(SHADER_CACHE_DIR, 0755);
+    FILE *file = fopen(tmpPath, "wb");
+    if (file == NULL)
+    {
+        printf("Failed to write shader cache: %s\n", tmpPath);
+        free(binary);
+        return;
+    }
+    bool ok = written > 0 && fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(binary, 1, written, file) == (size_t)written;
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+        ok = rename(tmpPath, path) == 0;
+    if (!ok)
+        remove(tmpPath);
+    free(binary);
+}
+
+static bool fileStamp(const char *path, struct ShaderFileStamp *stamp)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    stamp->size = (long long)st.st_size;
+    stamp->mtime = st.st_mtim;
+    return true;
+}
+
+static bool sameStamp(const struct ShaderFileStamp *a, const struct ShaderFileStamp *b)
+{
+    return a->size == b->size && a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+// Read both sources of program. Returns false (freeing anything read) if either is missing.
+static bool readSources(const struct ShaderProgram *program, char **vertex_source, char **fragment_source)
+{
+    *vertex_source = readFile(program->vertex_path);
+    *fragment_source = readFile(program->fragment_path);
+    if (*vertex_source && *fragment_source)
+        return true;
+    free(*vertex_source);
+    free(*fragment_source);
+    return false;
+}
+
+// Build a new program from the given sources, through the binary cache when possible.
+static GLuint buildProgram(const struct ShaderProgram *program, const char *vertex_source,
+                           const char *fragment_source, uint64_t source_hash)
+{
+    if (!programBinarySupported())
+        return linkProgramSources(vertex_source, fragment_source, false);
+
+    uint64_t key = programBinaryKey(source_hash);
+    GLuint shaderProgram = loadProgramBinary(program->cache_path, key);
+    if (shaderProgram == 0)
+    {
+        shaderProgram = linkProgramSources(vertex_source, fragment_source, true);
+        if (shaderProgram != 0)
+            saveProgramBinary(program->cache_path, key, shaderProgram);
+    }
+    return shaderProgram;
+}
+
+// Swap in a freshly linked program and cache its uniform locations.
+static void replaceProgram(struct ShaderProgram *program, GLuint shaderProgram)
+{
+    if (program->id != 0)
+        glDeleteProgram(program->id);
+    program->id = shaderProgram;
+    for (int i = 0; i < UNIFORM_COUNT; i++)
+        program->uniforms[i] = glGetUniformLocation(shaderProgram, uniformNames[i]);
+    program->generation++;
+}
+
+bool shaderProgramLoad(struct ShaderProgram *program, const char *vertex_shader_path, const char *fragment_shader_path)
+{
+    memset(program, 0, sizeof(*program));
+    snprintf(program->vertex_path, sizeof(program->vertex_path), "%s%s", SHADER_DIR, vertex_shader_path);
+    snprintf(program->fragment_path, sizeof(program->fragment_path), "%s%s", SHADER_DIR, fragment_shader_path);
+    snprintf(program->cache_path, sizeof(program->cache_path), "%s%s+%s.bin", SHADER_CACHE_DIR, vertex_shader_path,
+             fragment_shader_path);
+    program->next_check = SDL_GetTicks() + SHADER_RELOAD_INTERVAL_MS;
+    fileStamp(program->vertex_path, &program->vertex_stamp);
+    fileStamp(program->fragment_path, &program->fragment_stamp);
+
+    char *vertexSource, *fragmentSource;
+    if (!readSources(program, &vertexSource, &fragmentSource))
+        return false;
+    program->source_hash = sourceHash(vertexSource, fragmentSource);
+    GLuint shaderProgram = buildProgram(program, vertexSource, fragmentSource, program->source_hash);
+    free(vertexSource);
+    free(fragmentSource);
+    if (shaderProgram == 0)
+        return false;
+    replaceProgram(program, shaderProgram);
+    return true;
+}
+
+bool shaderProgramReloadIfChanged(struct ShaderProgram *program)
+{
+    Uint32 now = SDL_GetTicks();
+    if (!SDL_TICKS_PASSED(now, program->next_check))
+        return false;
+    program->next_check = now + SHADER_RELOAD_INTERVAL_MS;
+
+    // Steady state is two stat() calls: no reads and no allocations. A file
+    // that is missing right now is probably mid-save; try again next time.
+    struct ShaderFileStamp vertexStamp, fragmentStamp;
+    if (!fileStamp(program->vertex_path, &vertexStamp) || !fileStamp(program->fragment_path, &fragmentStamp))
+        return false;
+    if (sameStamp(&vertexStamp, &program->vertex_stamp) && sameStamp(&fragmentStamp, &program->fragment_stamp))
+        return false;
+    program->vertex_stamp = vertexStamp;
+    program->fragment_stamp = fragmentStamp;
+
+    // A stamp change may be a save without edits: only relink if the contents differ.
+    char *vertexSource, *fragmentSource;
+    if (!readSources(program, &vertexSource, &fragmentSource))
+        return false;
+    uint64_t hash = sourceHash(vertexSource, fragmentSource);
+    if (hash == program->source_hash)
+    {
+        free(vertexSource);
+        free(fragmentSource);
+        return false;
+    }
+    // Remember the new contents even if the build fails, so a broken shader is
+    // reported once per save rather than on every check.
+    program->source_hash = hash;
+
+    GLuint shaderProgram = buildProgram(program, vertexSource, fragmentSource, hash);
+    free(vertexSource);
+    free(fragmentSource);
+    if (shaderProgram == 0)
+    {
+        printf("Shader reload failed, keeping the previous program: %s, %s\n", program->vertex_path,
+               program->fragment_path);
+        return false;
+    }
+    replaceProgram(program, shaderProgram);
+    printf("Reloaded shaders: %s, %s\n", program->vertex_path, program->fragment_path);
+    return true;
+}
+
+void shaderProgramDestroy(struct ShaderProgram *program)
+{
+    if (program->id != 0)
+        glDeleteProgram(program->id);
+    memset(program, 0, sizeof(*program));
+}
@@ -4,9 +4,75 @@
 #define GL_GLEXT_PROTOTYPES
 #include <SDL2/SDL_opengl.h>
 #include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Shader sources live in the source tree, not next to the working directory;
+// CMake passes absolute paths so the game can be started from anywhere.
+#ifndef SHADER_DIR
+#define SHADER_DIR "src/shaders/"
+#endif
+#ifndef SHADER_CACHE_DIR
+#define SHADER_CACHE_DIR "shader_cache/"
+#endif
+
+#define SHADER_RELOAD_INTERVAL_MS 250 // how often the source files are checked for edits
+
+// Uniforms used by any of the programs. Locations are looked up once per link
+// (-1 when a program doesn't use one, which glUniform* ignores).
+enum ShaderUniform
+{
+    UNIFORM_MVP,
+    UNIFORM_MODEL,
+    UNIFORM_USE_OVERRIDE_COLOR,
+    UNIFORM_OVERRIDE_COLOR,
+    UNIFORM_LIGHT_DIR,
+    UNIFORM_LIGHT_COLOR,
+    UNIFORM_COUNT
+};
+
+// Size and modification time (nanosecond resolution) of a source file: a cheap
+// stat-only check of whether it may have been edited.
+struct ShaderFileStamp
+{
+    long long size;
+    struct timespec mtime;
+};
+
+// A linked program plus what is needed to rebuild it: uniform locations, the
+// source files, their stamps and a hash of the sources it was last built from.
+struct ShaderProgram
+{
+    GLuint id;
+    GLint uniforms[UNIFORM_COUNT];
+
+    char vertex_path[256];
+    char fragment_path[256];
+    char cache_path[256]; // linked binary, see shaderProgramLoad
+    struct ShaderFileStamp vertex_stamp;
+    struct ShaderFileStamp fragment_stamp;
+    uint64_t source_hash;
+    Uint32 next_check; // SDL ticks of the next source check
+
+    // Bumped on every successful (re)link. Uniform values don't survive a
+    // relink, so owners compare it to the generation they last configured.
+    int generation;
+};
 
 char *readFile(const char *filename);
-GLuint createShader(GLenum type, const char *filename);
-GLuint createShaderProgram();
+
+// Load a program from two files in the shader directory, using the program
+// binary cache when the driver supports it. Returns false on failure.
+bool shaderProgramLoad(struct ShaderProgram *program, const char *vertex_shader_path, const char *fragment_shader_path);
+
+// Relink if either source's contents changed. Polls only stat() the files; they
+// are read and hashed only when a stamp changed, and a file that is briefly
+// missing (editors replace it on save) is skipped silently until it is back.
+// If the new sources fail to build, the old program stays in use. Returns true
+// if the program was replaced.
+bool shaderProgramReloadIfChanged(struct ShaderProgram *program);
+
+void shaderProgramDestroy(struct ShaderProgram *program);
 
 #endif // SHADER_UTILS_H
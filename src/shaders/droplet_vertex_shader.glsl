@@ -0,0 +1,15 @@
+#version 330 core
+// Droplet positions arrive as three separate planes (SoA), one float each.
+layout (location = 0) in float aX;
+layout (location = 1) in float aY;
+layout (location = 2) in float aZ;
+
+uniform mat4 mvp;
+
+flat out float height;  // matches fragment_shader.glsl
+
+void main()
+{
+    height = aY;
+    gl_Position = mvp * vec4(aX, aY, aZ, 1.0);
+}
@@ -1,38 +1,162 @@
 #include "state.h"
 #include <math.h>
+#include "jobs.h"
 
-// Fill the grid with a sine-wave heightmap normalized to [0, 1.0] (now affecting Y).
-void initializeGrid(struct State *state)
+#define ROW_GRAIN 4 // grid rows per parallel_for piece
+
+static void initializeRows(void *ctx, int begin, int end)
 {
-    for (int i = 0; i < GRID_SIZE; i++)
+    struct State *state = ctx;
+    for (int i = begin; i < end; i++)
     {
         for (int j = 0; j < GRID_SIZE; j++)
         {
             float x = (float)i / (GRID_SIZE - 1);
             float z = (float)j / (GRID_SIZE - 1);
             // Scale the sine/cosine to produce heights between 0.0 and 0.1.
-            state->grid[i][j] = 0.5f * sinf(x * 3.1415f * 4) * cosf(z * 3.1415f * 4) + 0.5f;
+            float h = 0.5f * sinf(x * 3.1415f * 4) * cosf(z * 3.1415f * 4) + 0.5f;
+            state->grid[i][j] = h;
+            // Start as soil over bedrock with no deposited sediment.
+            state->soil_top[i][j] = quantizeElevation(h);
+            state->bedrock_top[i][j] = quantizeElevation(h - INITIAL_SOIL_DEPTH);
         }
     }
 }
 
-// Generate a mesh (two triangles per grid cell) from the heightmap.
-void generateMesh(float *vertices, struct State *state)
+void setDropletErosion(struct ErosionParams *params, bool enabled)
 {
-    int vertex = 0;
-    for (int i = 0; i < GRID_SIZE - 1; i++)
+    params->erode_rate = enabled ? DROPLET_EROSION_RATE : 0.0f;
+    params->deposit_rate = enabled ? DROPLET_EROSION_RATE : 0.0f;
+}
+
+// Fill the grid with a sine-wave heightmap normalized to [0, 1.0] (now affecting Y).
+void initializeGrid(struct State *state)
+{
+    jobs_parallel_for(0, GRID_SIZE, ROW_GRAIN, initializeRows, state);
+}
+
+// Defaults reproduce the original droplets: the motion constants are the old
+// hardcoded ones and droplet erosion is off (erode/deposit rates of 0 leave the
+// grid untouched). setDropletErosion switches it on.
+void initErosionParams(struct ErosionParams *params)
+{
+    params->dt = 0.016f; // ~60 FPS timestep
+    params->gravity = 9.8f;
+    params->fall_threshold = 0.05f;
+    params->surface_offset = 0.05f;
+    params->horizontal_speed = 0.01f;
+    params->slide_step = 0.001f;
+    params->inertia = 0.0f;
+    params->capacity = 4.0f;
+    params->min_slope = 0.0005f;
+    params->erode_rate = 0.0f;
+    params->deposit_rate = 0.0f;
+    params->brush_radius = 1;
+    params->erodibility_sediment = 1.0f;
+    params->erodibility_soil = 0.6f;
+    params->erodibility_bedrock = 0.1f;
+    params->record_trail = true;
+    params->bilinear = false;
+
+    params->rain_enabled = true;
+    params->talus_slope = 1.2f;
+    params->relax_iterations = 4;
+
+    params->wind_enabled = false;
+    params->wind_x = 1.0f;
+    params->wind_z = 0.35f;
+    params->wind_capacity = 0.002f;
+    params->wind_erode_rate = 0.2f;
+    params->wind_deposit_rate = 0.3f;
+    params->wind_shadow_slope = 0.27f; // ~15 degrees
+    params->wind_exposure_scale = 0.01f;
+}
+
+void initBrush(struct Brush *brush)
+{
+    brush->tool = BRUSH_RAISE;
+    brush->radius = 0.15f;
+    brush->strength = 0.01f;
+    brush->burst_droplets = 16;
+}
+
+void markDirty(struct State *state, int x0, int z0, int x1, int z1)
+{
+    // A height is a corner of the cells up and left of it too.
+    x0 -= 1;
+    z0 -= 1;
+    if (x0 < 0)
+        x0 = 0;
+    if (z0 < 0)
+        z0 = 0;
+    if (x1 > GRID_SIZE - 2)
+        x1 = GRID_SIZE - 2;
+    if (z1 > GRID_SIZE - 2)
+        z1 = GRID_SIZE - 2;
+    if (x0 > x1 || z0 > z1)
+        return;
+
+    for (int ti = x0 / MESH_TILE; ti <= x1 / MESH_TILE; ti++)
     {
-        for (int j = 0; j < GRID_SIZE - 1; j++)
+        for (int tj = z0 / MESH_TILE; tj <= z1 / MESH_TILE; tj++)
+            state->dirty_tiles |= meshTileBit(ti, tj);
+    }
+}
+
+uint64_t takeDirty(struct State *state)
+{
+    uint64_t tiles = state->dirty_tiles;
+    state->dirty_tiles = 0;
+    return tiles;
+}
+
+bool initArenas(struct State *state)
+{
+    if (!arena_init(&state->frame_arena, "frame", FRAME_ARENA_SIZE))
+        return false;
+    if (!arena_init(&state->sim_arena, "simulation", SIM_ARENA_SIZE))
+    {
+        arena_destroy(&state->frame_arena);
+        return false;
+    }
+    return true;
+}
+
+void destroyArenas(struct State *state)
+{
+    arena_destroy(&state->frame_arena);
+    arena_destroy(&state->sim_arena);
+}
+
+struct MeshTask
+{
+    float *vertices;
+    const float *heights; // height of vertex (i0, j0); rows are stride floats apart
+    int stride;
+    int i0, j0, j1;
+};
+
+// Mesh cell rows [begin, end) of the region; each row owns a fixed slice of the vertex array.
+static void generateMeshRows(void *ctx, int begin, int end)
+{
+    struct MeshTask *task = ctx;
+    float *vertices = task->vertices;
+    const int stride = task->stride;
+    int vertex = (begin - task->i0) * (task->j1 - task->j0 + 1) * 18;
+    for (int i = begin; i < end; i++)
+    {
+        const float *row = task->heights + (size_t)(i - task->i0) * stride - task->j0;
+        for (int j = task->j0; j <= task->j1; j++)
         {
             float x0 = (float)i / (GRID_SIZE - 1) * 2 - 1;
             float z0 = (float)j / (GRID_SIZE - 1) * 2 - 1;
             float x1 = (float)(i + 1) / (GRID_SIZE - 1) * 2 - 1;
             float z1 = (float)(j + 1) / (GRID_SIZE - 1) * 2 - 1;
 
-            float y00 = state->grid[i][j];
-            float y10 = state->grid[i + 1][j];
-            float y01 = state->grid[i][j + 1];
-            float y11 = state->grid[i + 1][j + 1];
+            float y00 = row[j];
+            float y10 = row[stride + j];
+            float y01 = row[j + 1];
+            float y11 = row[stride + j + 1];
 
             // First triangle
             vertices[vertex++] = x0;
@@ -58,3 +182,21 @@ void generateMesh(float *vertices, struct State *state)
         }
     }
 }
+
+// Generate the triangles of cells [i0,i1] x [j0,j1], packed row by row.
+void generateMeshRegion(float *vertices, const float *heights, int stride, int i0, int i1, int j0, int j1)
+{
+    struct MeshTask task = {vertices, heights, stride, i0, j0, j1};
+    jobs_parallel_for(i0, i1 + 1, ROW_GRAIN, generateMeshRows, &task);
+}
+
+// Generate a mesh (two triangles per grid cell) from a heightmap, e.g. a snapshot of state->grid.
+void generateMeshFromGrid(float *vertices, const float (*grid)[GRID_SIZE])
+{
+    generateMeshRegion(vertices, &grid[0][0], GRID_SIZE, 0, GRID_SIZE - 2, 0, GRID_SIZE - 2);
+}
+
+void generateMesh(float *vertices, struct State *state)
+{
+    generateMeshFromGrid(vertices, (const float (*)[GRID_SIZE])state->grid);
+}
@@ -2,44 +2,202 @@
 #define STATE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
 
 #define GRID_SIZE 64
 #define TRAIL_LENGTH 32 // number of positions to store in the trail
 
 #define TRAIL_LENGTH 32      // number of positions to store in the trail
 #define MAX_STAGNANT_STEPS 8 // for example, 60 frames (~1 sec at 60 FPS)
+#define DROPLET_COUNT 1024   // size of the droplet population
+
+#define MESH_FLOAT_COUNT ((GRID_SIZE - 1) * (GRID_SIZE - 1) * 6 * 3) // floats written by generateMesh
+#define FRAME_ARENA_SIZE (2u << 20) // per-frame scratch (mesh vertices, render staging)
+#define SIM_ARENA_SIZE (1u << 20)   // per-pass erosion scratch
+
+// Mesh cells are tracked for re-meshing in MESH_TILE x MESH_TILE tiles, one bit each.
+#define MESH_TILE 8
+#define MESH_TILES ((GRID_SIZE - 1 + MESH_TILE - 1) / MESH_TILE) // tiles per side
+_Static_assert(MESH_TILES * MESH_TILES <= 64, "dirty tiles must fit in a uint64_t");
+
+// Layer interfaces are stored as 16-bit elevations over the valid height range [0, 2].
+#define LAYER_QUANT_SCALE (65535.0f / 2.0f)
+#define INITIAL_SOIL_DEPTH 0.2f
+
+#define DROPLET_EROSION_RATE 0.1f // erode/deposit rate when droplet erosion is switched on
 
 struct Droplet
 {
     float x, y, z;  // x,z horizontal; y vertical position
-    float sediment; // unused for now
-    float water;    // unused for now
-    float speed;    // unused for now
+    float sediment; // sediment carried
+    float water;    // water volume (scales carrying capacity)
+    float speed;    // speed along the surface while sliding
+    float dir_x, dir_z; // current travel direction (used with inertia)
     bool active;    // is droplet alive/active?
 
+    // Height change produced by the last step, applied after all droplets have
+    // stepped (positive deposits, negative erodes) at (deposit_x, deposit_z).
+    float deposit_x, deposit_z;
+    float deposit_amount;
+
     // Trail: store last TRAIL_LENGTH positions (each as x,y,z)
     float trail[TRAIL_LENGTH][3];
     int trail_count; // number of valid positions in the trail
 
     int stagnant_steps; // number of consecutive steps with near-zero gradient
+
+    uint32_t rng; // per-droplet random stream (see seedDroplets)
+};
+
+// Runtime droplet/erosion parameters. The hot loop never branches on these:
+// selectDropletKernel() picks a variant compiled for the feature flags.
+struct ErosionParams
+{
+    float dt;               // simulation timestep
+    float gravity;
+    float fall_threshold;   // droplet free-falls while this far above the terrain
+    float surface_offset;   // droplet rendered this far above the mesh
+    float horizontal_speed; // horizontal drift while falling
+    float slide_step;       // fixed step along the surface while sliding
+    float inertia;          // 0 = follow the gradient, towards 1 = keep heading
+    float capacity;         // sediment capacity factor
+    float min_slope;        // capacity floor on flat ground
+    float erode_rate;
+    float deposit_rate;
+    int brush_radius;       // erosion/deposition radius in cells (0 = single cell)
+    bool record_trail;      // keep trails (also enables the loop/cavity reset)
+    bool bilinear;          // bilinear height sampling instead of nearest cell
+
+    // Erodibility of each terrain material (1 = erodes at the full requested rate).
+    float erodibility_sediment;
+    float erodibility_soil;
+    float erodibility_bedrock;
+
+    // Wind (aeolian) erosion, run after the droplets each step when enabled.
+    bool wind_enabled;
+    float wind_x, wind_z;      // wind vector in world axes; its length is the strength
+    float wind_capacity;       // sediment a unit-strength wind can carry per cell
+    float wind_erode_rate;     // fraction of spare capacity lifted per cell
+    float wind_deposit_rate;   // fraction of excess load dropped per cell
+    float wind_shadow_slope;   // slope of the wind shadow behind upwind terrain
+    float wind_exposure_scale; // height above the shadow at which a cell is fully exposed
+
+    // Rain: with rain off, droplets that finish are not respawned, so only
+    // local bursts from the rain brush keep eroding. Switch it with setRain.
+    bool rain_enabled;
+
+    // Local re-simulation after edits: slumping of slopes steeper than the talus slope.
+    float talus_slope;
+    int relax_iterations;
+};
+
+// Inclusive range of grid cells.
+struct CellRect
+{
+    int x0, z0, x1, z1;
+    bool valid;
+};
+
+enum BrushTool
+{
+    BRUSH_RAISE,
+    BRUSH_LOWER,
+    BRUSH_SMOOTH,
+    BRUSH_RAIN,
+};
+
+struct Brush
+{
+    enum BrushTool tool;
+    float radius;   // world units
+    float strength; // height change per frame at the brush center
+    int burst_droplets; // droplets spawned per frame by the rain tool
 };
 
 struct State
 {
     bool quit;
+
+    // The simulation is always deterministic: with the same seed a run is
+    // reproducible bit-for-bit, whatever the thread count. Parallel passes
+    // only write data owned by their range, and droplet deposits are applied
+    // serially in droplet order (see stepSimulation).
+    uint32_t seed;
+
+    // Surface height. Hot loops (droplet sampling, meshing) read only this plane.
     float grid[GRID_SIZE][GRID_SIZE];
 
+    // Terrain layers as quantized interface elevations, one plane each (SoA):
+    // bedrock below bedrock_top, soil up to soil_top, deposited sediment from
+    // there up to the surface. Only touched when erosion writes a cell.
+    uint16_t bedrock_top[GRID_SIZE][GRID_SIZE];
+    uint16_t soil_top[GRID_SIZE][GRID_SIZE];
+
     // Camera orbit parameters
     float orbit_angle; // in radians
     float dist;        // distance from mountain center
     float height;      // camera height (Y)
 
-    // We'll keep one droplet for demonstration
-    struct Droplet droplet;
+    // Inverse of the last frame's projection * view, for picking.
+    float inv_view_proj[16];
+    bool have_camera;
+    int viewport_w, viewport_h;
+
+    // Droplet population (allocated in main, DROPLET_COUNT entries)
+    struct Droplet *droplets;
+    int droplet_count;
+    int burst_cursor; // next droplet the rain brush recycles
+
+    struct Brush brush;
+    uint64_t dirty_tiles; // mesh tiles changed since the mesh was last updated (meshTileBit)
+
+    struct ErosionParams params;
+
+    // Scratch memory: frame_arena is reset at the start of every frame and only
+    // used by the render thread; sim_arena is reset at the start of every
+    // simulation step and only allocated from by its serial parts (the deposit
+    // apply pass and the wind-pass setup), never from inside parallel ranges.
+    struct Arena frame_arena;
+    struct Arena sim_arena;
 };
 
+// Round down so a stored interface never sits above the surface it came from.
+static inline uint16_t quantizeElevation(float h)
+{
+    if (h <= 0.0f)
+        return 0;
+    if (h >= 2.0f)
+        return 65535;
+    return (uint16_t)(h * LAYER_QUANT_SCALE);
+}
+
+static inline float dequantizeElevation(uint16_t q)
+{
+    return q * (1.0f / LAYER_QUANT_SCALE);
+}
+
+// Bit of the tile holding mesh cells [ti * MESH_TILE, ...] x [tj * MESH_TILE, ...].
+static inline uint64_t meshTileBit(int ti, int tj)
+{
+    return (uint64_t)1 << (ti * MESH_TILES + tj);
+}
+
 // from state.c
 void initializeGrid(struct State *state);
+void initErosionParams(struct ErosionParams *params);
+void setDropletErosion(struct ErosionParams *params, bool enabled);
+bool initArenas(struct State *state);
+void initBrush(struct Brush *brush);
+
+// Mark the mesh tiles that use heights [x0,x1] x [z0,z1] (clamped to the grid) as dirty.
+void markDirty(struct State *state, int x0, int z0, int x1, int z1);
+// Return the dirty tiles and clear them.
+uint64_t takeDirty(struct State *state);
+void destroyArenas(struct State *state);
 void generateMesh(float *vertices, struct State *state);
+void generateMeshFromGrid(float *vertices, const float (*grid)[GRID_SIZE]);
+// Cells [i0,i1] x [j0,j1] only; heights points at vertex (i0,j0), rows stride floats apart.
+void generateMeshRegion(float *vertices, const float *heights, int stride, int i0, int i1, int j0, int j1);
 
 #endif // STATE_H
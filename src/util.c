@@ -1,8 +1,31 @@
 #include "util.h"
-#include <stdlib.h>
 
-float rand_range(float min, float max)
+// Mix seed and stream into a well-distributed, non-zero starting state.
+uint32_t rng_seed(uint32_t seed, uint32_t stream)
 {
-    float scale = rand() / (float)RAND_MAX;
+    uint32_t h = seed * 0x9E3779B9u ^ (stream + 0x7F4A7C15u) * 0x85EBCA6Bu;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h ? h : 1u;
+}
+
+// xorshift32
+uint32_t rng_next(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float rng_range(uint32_t *state, float min, float max)
+{
+    // Top 24 bits give an exactly representable float in [0, 1].
+    float scale = (rng_next(state) >> 8) / (float)(1u << 24);
     return min + scale * (max - min);
 }
@@ -1,7 +1,11 @@
-
 #ifndef UTIL_H
 #define UTIL_H
 
-float rand_range(float min, float max);
+#include <stdint.h>
+
+// Small per-stream generator so results don't depend on call order across droplets/threads.
+uint32_t rng_seed(uint32_t seed, uint32_t stream);
+uint32_t rng_next(uint32_t *state);
+float rng_range(uint32_t *state, float min, float max);
 
 #endif
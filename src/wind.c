@@ -0,0 +1,131 @@
+#include "wind.h"
+#include <math.h>
+#include "gen.h"
+#include "jobs.h"
+
+#define WIND_BLOCK 16 // neighbouring lines swept together (one parallel_for item)
+
+// Per-pass constants, shared by every line. Lines follow the wind: each step
+// moves one cell along the major axis (the larger wind component) and the
+// minor coordinate follows a DDA offset, so every cell lies on exactly one line.
+struct WindSweep
+{
+    struct State *state;
+    bool major_x;       // true: lines step along x (grid rows), false: along z
+    int forward;        // 1: sweep towards increasing major index, 0: decreasing
+    const int *offset;  // minor offset of the line at step k, GRID_SIZE entries
+    int first_line;     // minor coordinate at step 0 of line 0
+    float capacity;     // carrying capacity of a fully exposed cell
+    float erode_rate;
+    float deposit_rate;
+    float shadow_drop;  // shadow height lost per step downwind
+    float inv_exposure; // 1 / exposure scale
+};
+
+// Advance one line by one cell. shadow is the height of the wind shadow cast by
+// everything upwind; load is the sand in transport.
+static inline void windCell(const struct WindSweep *w, int x, int z, float *shadow, float *load)
+{
+    float h = w->state->grid[x][z];
+    float exposure = (h - *shadow) * w->inv_exposure;
+    exposure = exposure < 0.0f ? 0.0f : (exposure > 1.0f ? 1.0f : exposure);
+    float capacity = w->capacity * exposure;
+
+    float change;
+    if (*load < capacity)
+        change = -(capacity - *load) * w->erode_rate;
+    else
+        change = (*load - capacity) * w->deposit_rate;
+    // Harder layers give up less than asked; only what actually moved is carried.
+    if (change != 0.0f)
+        change = addCellHeight(w->state, x, z, change);
+    *load -= change;
+
+    // The shadow for the next cell: this cell's new top or the old shadow, sloping down.
+    float top = h + change;
+    *shadow = (top > *shadow ? top : *shadow) - w->shadow_drop;
+}
+
+// Sweep blocks of WIND_BLOCK neighbouring lines, walking them in wind order
+// together. For x-major winds a step touches one contiguous run of a grid row
+// (the lines' minor coordinates are consecutive z); for z-major winds each line
+// already walks along a row, so a step touches one cell in each of WIND_BLOCK
+// rows and every line streams through its row. Lines are disjoint, so blocks
+// can run in parallel.
+static void sweepLineBlocks(void *ctx, int begin, int end)
+{
+    const struct WindSweep *w = ctx;
+    for (int block = begin; block < end; block++)
+    {
+        float shadow[WIND_BLOCK], load[WIND_BLOCK];
+        for (int l = 0; l < WIND_BLOCK; l++)
+        {
+            shadow[l] = -1e30f;
+            load[l] = 0.0f;
+        }
+        int c0 = w->first_line + block * WIND_BLOCK;
+        for (int k = 0; k < GRID_SIZE; k++)
+        {
+            int major = w->forward ? k : GRID_SIZE - 1 - k;
+            for (int l = 0; l < WIND_BLOCK; l++)
+            {
+                // Lines entering through a side edge start with no load and no shadow.
+                int minor = c0 + l + w->offset[k];
+                if (minor < 0 || minor >= GRID_SIZE)
+                    continue;
+                if (w->major_x)
+                    windCell(w, major, minor, &shadow[l], &load[l]);
+                else
+                    windCell(w, minor, major, &shadow[l], &load[l]);
+            }
+        }
+    }
+}
+
+void windErosionPass(struct State *state)
+{
+    const struct ErosionParams *p = &state->params;
+    float strength = sqrtf(p->wind_x * p->wind_x + p->wind_z * p->wind_z);
+    if (strength == 0.0f)
+        return;
+
+    // Minor offsets of the DDA line per step, from pass scratch.
+    int *offset = arena_alloc(&state->sim_arena, sizeof(int) * GRID_SIZE, 64);
+    if (!offset)
+        return;
+
+    struct WindSweep sweep;
+    sweep.state = state;
+    sweep.major_x = fabsf(p->wind_x) >= fabsf(p->wind_z);
+    float majorComponent = sweep.major_x ? p->wind_x : p->wind_z;
+    float minorComponent = sweep.major_x ? p->wind_z : p->wind_x;
+    sweep.forward = majorComponent > 0.0f;
+
+    // Minor cells moved per major step along the wind, in [-1, 1]. The offset
+    // counts from the upwind edge, so it follows the sweep direction.
+    float slope = minorComponent / fabsf(majorComponent);
+    int minOffset = 0, maxOffset = 0;
+    for (int k = 0; k < GRID_SIZE; k++)
+    {
+        offset[k] = (int)floorf(k * slope + 0.5f);
+        minOffset = offset[k] < minOffset ? offset[k] : minOffset;
+        maxOffset = offset[k] > maxOffset ? offset[k] : maxOffset;
+    }
+    // Every line that crosses the grid: start coordinates from -maxOffset to GRID_SIZE - 1 - minOffset.
+    sweep.offset = offset;
+    sweep.first_line = -maxOffset;
+    int lines = GRID_SIZE + maxOffset - minOffset;
+
+    // A step covers sqrt(1 + slope^2) cells of distance, and the full wind
+    // strength carries sand along the line.
+    const float cellSize = 2.0f / (GRID_SIZE - 1);
+    sweep.capacity = strength * p->wind_capacity;
+    sweep.erode_rate = p->wind_erode_rate;
+    sweep.deposit_rate = p->wind_deposit_rate;
+    sweep.shadow_drop = p->wind_shadow_slope * cellSize * sqrtf(1.0f + slope * slope);
+    sweep.inv_exposure = 1.0f / p->wind_exposure_scale;
+
+    int blocks = (lines + WIND_BLOCK - 1) / WIND_BLOCK;
+    jobs_parallel_for(0, blocks, 1, sweepLineBlocks, &sweep);
+    markDirty(state, 0, 0, GRID_SIZE - 1, GRID_SIZE - 1);
+}
@@ -0,0 +1,12 @@
+#ifndef WIND_H
+#define WIND_H
+
+#include "state.h"
+
+// One step of wind erosion: saltating sand is lifted from exposed cells and
+// dropped in the wind shadow of upwind terrain. The grid is swept along lines
+// parallel to the wind vector (rasterized with a DDA), so shadows fall in the
+// wind direction and the vector's length sets the carrying capacity.
+void windErosionPass(struct State *state);
+
+#endif // WIND_H
@@ -0,0 +1,105 @@
+// Tests for the terrain brushes on the initial sine terrain: a brush that asks
+// for no change must leave the grid alone (the talus relax pass only undoes
+// slope the edit added), and holding RAISE adds about strength per frame.
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "edit.h"
+#include "state.h"
+
+#define HOLD_FRAMES 60
+
+// World coordinate of grid vertex i.
+static float cellToWorld(int i)
+{
+    return (float)i / (0.5f * (GRID_SIZE - 1)) - 1.0f;
+}
+
+static void resetTerrain(struct State *state, enum BrushTool tool, float strength)
+{
+    initErosionParams(&state->params);
+    initBrush(&state->brush);
+    state->brush.tool = tool;
+    state->brush.strength = strength;
+    initializeGrid(state);
+    state->dirty_tiles = 0;
+}
+
+// Hold the brush at vertex (ci, cj) for frames frames, resetting frame scratch like the render loop.
+static void holdBrush(struct State *state, int ci, int cj, int frames)
+{
+    for (int f = 0; f < frames; f++)
+    {
+        arena_reset(&state->frame_arena);
+        applyBrush(state, cellToWorld(ci), cellToWorld(cj));
+    }
+}
+
+static bool testZeroStrength(struct State *state)
+{
+    static const enum BrushTool tools[] = {BRUSH_RAISE, BRUSH_LOWER};
+    static const int spots[][2] = {{16, 16}, {8, 40}, {31, 31}, {0, 63}};
+    float initial[GRID_SIZE][GRID_SIZE];
+    for (size_t t = 0; t < sizeof(tools) / sizeof(tools[0]); t++)
+    {
+        for (size_t s = 0; s < sizeof(spots) / sizeof(spots[0]); s++)
+        {
+            resetTerrain(state, tools[t], 0.0f);
+            memcpy(initial, state->grid, sizeof(initial));
+            holdBrush(state, spots[s][0], spots[s][1], HOLD_FRAMES);
+            if (memcmp(initial, state->grid, sizeof(initial)) != 0)
+            {
+                printf("[FAIL] zero_strength: tool %d at (%d,%d) changed the terrain\n", (int)tools[t],
+                       spots[s][0], spots[s][1]);
+                return false;
+            }
+        }
+    }
+    printf("[ OK ] zero_strength\n");
+    return true;
+}
+
+// The brush weight is 1 at its center, so the center vertex rises by strength every frame.
+static bool testRaiseAccumulates(struct State *state)
+{
+    static const int spots[][2] = {{16, 16}, {24, 40}, {32, 32}};
+    const float strength = 0.01f;
+    for (size_t s = 0; s < sizeof(spots) / sizeof(spots[0]); s++)
+    {
+        int ci = spots[s][0], cj = spots[s][1];
+        resetTerrain(state, BRUSH_RAISE, strength);
+        float start = state->grid[ci][cj];
+        holdBrush(state, ci, cj, HOLD_FRAMES);
+        float lifted = state->grid[ci][cj] - start;
+        float expected = strength * HOLD_FRAMES;
+        if (fabsf(lifted - expected) > 0.1f * expected)
+        {
+            printf("[FAIL] raise_accumulates: (%d,%d) rose %g, expected about %g\n", ci, cj, lifted, expected);
+            return false;
+        }
+    }
+    printf("[ OK ] raise_accumulates\n");
+    return true;
+}
+
+int main(void)
+{
+    struct State *state = calloc(1, sizeof(struct State));
+    if (!state || !initArenas(state))
+    {
+        printf("Failed to allocate test state.\n");
+        free(state);
+        return 1;
+    }
+
+    int failures = 0;
+    failures += !testZeroStrength(state);
+    failures += !testRaiseAccumulates(state);
+
+    destroyArenas(state);
+    free(state);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+// Golden replay tests for the simulation core (no SDL/GL needed).
+// Runs the seeded scenarios in src/replay.c serially and on N job workers,
+// checks that both runs are bit-identical and compares their final heightmaps
+// and droplet state with the snapshots in a golden directory.
+//
+//   erosion_tests DIR [--threads N]           check against DIR/<scenario>.hmap
+//   erosion_tests DIR --record [--threads N]  (re)write the snapshots after an intended change
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+static void printUsage(const char *program)
+{
+    printf("Usage: %s GOLDEN_DIR [--record] [--threads N]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = NULL;
+    bool record = false;
+    int threads = -1; // one worker per extra core
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--record") == 0)
+        {
+            record = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (dir == NULL && argv[i][0] != '-')
+        {
+            dir = argv[i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (dir == NULL)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    int failures = runReplay(dir, record, threads);
+    return failures == 0 ? 0 : 1;
+}
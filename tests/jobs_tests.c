@@ -0,0 +1,194 @@
+// Tests for the job system's task graph: dependency ordering, dependents that
+// overflow a job's list (waited for in jobs_submit) and an exhausted job pool.
+//
+//   jobs_tests [--threads N]
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+#define OVERFLOW_DEPENDENTS 16 // more than a job can record
+#define EXHAUSTED_RANGE 10000
+
+// Global order in which jobs finished; a stamp of 0 means "not run yet".
+static atomic_int clock_ticks;
+
+struct Stamp
+{
+    atomic_int stamp;
+    int sleep_us; // keep the job busy so dependents really have to wait
+};
+
+static void stampJob(void *ctx)
+{
+    struct Stamp *s = ctx;
+    if (s->sleep_us > 0)
+        usleep(s->sleep_us);
+    atomic_store(&s->stamp, atomic_fetch_add(&clock_ticks, 1) + 1);
+}
+
+static void resetStamps(struct Stamp *stamps, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        atomic_store(&stamps[i].stamp, 0);
+        stamps[i].sleep_us = 0;
+    }
+}
+
+static bool ranAfter(struct Stamp *later, struct Stamp *earlier)
+{
+    int a = atomic_load(&later->stamp), b = atomic_load(&earlier->stamp);
+    return a != 0 && b != 0 && a > b;
+}
+
+// Diamond a, b -> c -> d, with a slow root, repeated to shake out races.
+static bool testDependencyOrder(void)
+{
+    for (int round = 0; round < 200; round++)
+    {
+        struct Stamp s[4];
+        resetStamps(s, 4);
+        s[0].sleep_us = round % 10 == 0 ? 2000 : 0;
+
+        struct Job *a = jobs_submit(stampJob, &s[0], NULL, 0);
+        struct Job *b = jobs_submit(stampJob, &s[1], NULL, 0);
+        struct Job *ab[2] = {a, b};
+        struct Job *c = jobs_submit(stampJob, &s[2], ab, 2);
+        struct Job *d = jobs_submit(stampJob, &s[3], &c, 1);
+        jobs_wait(d);
+        jobs_wait(c);
+        jobs_wait(b);
+        jobs_wait(a);
+
+        if (!ranAfter(&s[2], &s[0]) || !ranAfter(&s[2], &s[1]) || !ranAfter(&s[3], &s[2]))
+        {
+            printf("[FAIL] dependency_order: round %d ran out of order\n", round);
+            return false;
+        }
+    }
+    printf("[ OK ] dependency_order\n");
+    return true;
+}
+
+// Dependents beyond what the root can record are satisfied by jobs_submit
+// waiting for the root (helpUntilDone), so every one of them still runs after it.
+static bool testDependentOverflow(void)
+{
+    struct Stamp root;
+    struct Stamp dependents[OVERFLOW_DEPENDENTS];
+    struct Job *handles[OVERFLOW_DEPENDENTS];
+    resetStamps(&root, 1);
+    resetStamps(dependents, OVERFLOW_DEPENDENTS);
+    root.sleep_us = 20000;
+
+    struct Job *rootJob = jobs_submit(stampJob, &root, NULL, 0);
+    for (int i = 0; i < OVERFLOW_DEPENDENTS; i++)
+        handles[i] = jobs_submit(stampJob, &dependents[i], &rootJob, 1);
+    // Only the fallback makes the submitting thread wait for the slow root.
+    bool waited = atomic_load(&root.stamp) != 0;
+    for (int i = 0; i < OVERFLOW_DEPENDENTS; i++)
+        jobs_wait(handles[i]);
+    jobs_wait(rootJob);
+
+    if (!waited)
+    {
+        printf("[FAIL] dependent_overflow: submitting past the dependent list did not wait for the root\n");
+        return false;
+    }
+    for (int i = 0; i < OVERFLOW_DEPENDENTS; i++)
+    {
+        if (!ranAfter(&dependents[i], &root))
+        {
+            printf("[FAIL] dependent_overflow: dependent %d ran before the root\n", i);
+            return false;
+        }
+    }
+    printf("[ OK ] dependent_overflow\n");
+    return true;
+}
+
+static atomic_int counted;
+
+static void countJob(void *ctx)
+{
+    (void)ctx;
+    atomic_fetch_add(&counted, 1);
+}
+
+static void markRange(void *ctx, int begin, int end)
+{
+    unsigned char *visits = ctx;
+    for (int i = begin; i < end; i++)
+        visits[i]++;
+}
+
+// With every job handle held, parallel_for can't split and must run inline;
+// once the handles are released the pool is usable again.
+static bool testPoolExhaustion(void)
+{
+    struct Job **handles = malloc(sizeof(struct Job *) * JOBS_MAX_JOBS);
+    unsigned char *visits = calloc(EXHAUSTED_RANGE, 1);
+    if (!handles || !visits)
+    {
+        printf("[FAIL] pool_exhaustion: out of memory\n");
+        free(handles);
+        free(visits);
+        return false;
+    }
+
+    atomic_store(&counted, 0);
+    for (int i = 0; i < JOBS_MAX_JOBS; i++)
+        handles[i] = jobs_submit(countJob, NULL, NULL, 0);
+    jobs_parallel_for(0, EXHAUSTED_RANGE, 1, markRange, visits);
+    for (int i = 0; i < JOBS_MAX_JOBS; i++)
+        jobs_wait(handles[i]);
+
+    bool ok = atomic_load(&counted) == JOBS_MAX_JOBS;
+    for (int i = 0; i < EXHAUSTED_RANGE; i++)
+        ok = ok && visits[i] == 1;
+
+    // Recycled handles: submit twice the pool, waiting as we go.
+    memset(visits, 0, EXHAUSTED_RANGE);
+    for (int i = 0; i < 2 * JOBS_MAX_JOBS; i++)
+        jobs_wait(jobs_submit(countJob, NULL, NULL, 0));
+    jobs_parallel_for(0, EXHAUSTED_RANGE, 1, markRange, visits);
+    ok = ok && atomic_load(&counted) == 3 * JOBS_MAX_JOBS;
+    for (int i = 0; i < EXHAUSTED_RANGE; i++)
+        ok = ok && visits[i] == 1;
+
+    free(handles);
+    free(visits);
+    printf(ok ? "[ OK ] pool_exhaustion\n" : "[FAIL] pool_exhaustion: jobs lost or run twice\n");
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = -1; // one worker per extra core
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else
+        {
+            printf("Usage: %s [--threads N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    jobs_init(threads);
+    printf("Running job system tests on %d thread(s).\n", jobs_worker_count());
+    int failures = 0;
+    failures += !testDependencyOrder();
+    failures += !testDependentOverflow();
+    failures += !testPoolExhaustion();
+    jobs_shutdown();
+    return failures == 0 ? 0 : 1;
+}